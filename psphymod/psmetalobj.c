@@ -88,10 +88,118 @@ ps_metal_obj_free (PSMetalObj *obj)
       for (i = 0; i < obj->num_nodes; i++)
         ps_metal_obj_node_free (obj->nodes[i]);
 
+      free (obj->active);
+      free (obj->work);
+      free (obj->neighbor_index);
       free (obj);
     }
 }
 
+typedef
+struct _NodeIndex
+{
+  const PSMetalObjNode *node;
+  int                  index;
+} NodeIndex;
+
+static int
+node_index_compare (const void *a, const void *b)
+{
+  const PSMetalObjNode *na = ((const NodeIndex*) a)->node;
+  const PSMetalObjNode *nb = ((const NodeIndex*) b)->node;
+
+  return na < nb ? -1 : na > nb;
+}
+
+/* Index into obj->nodes of every neighbor, node by node, in one array.
+   Returns NULL if out of memory. */
+static int *
+ps_metal_obj_neighbor_indices (const PSMetalObj *obj)
+{
+  NodeIndex *index, key, *found;
+  int *indices;
+  int i, j, k, total = 0;
+
+  for (i = 0; i < obj->num_nodes; i++)
+    total += obj->nodes[i]->num_neighbors;
+
+  index = (NodeIndex*) malloc (sizeof (NodeIndex) * obj->num_nodes);
+  indices = (int*) malloc (sizeof (int) * (total > 0 ? total : 1));
+  if (index == NULL || indices == NULL)
+    {
+      free (index);
+      free (indices);
+      return NULL;
+    }
+
+  for (i = 0; i < obj->num_nodes; i++)
+    {
+      index[i].node = obj->nodes[i];
+      index[i].index = i;
+    }
+
+  qsort (index, obj->num_nodes, sizeof (NodeIndex), node_index_compare);
+  for (i = k = 0; i < obj->num_nodes; i++)
+    for (j = 0; j < obj->nodes[i]->num_neighbors; j++)
+      {
+        key.node = obj->nodes[i]->neighbors[j];
+        found = (NodeIndex*) bsearch (&key, index, obj->num_nodes,
+                                      sizeof (NodeIndex), node_index_compare);
+        indices[k++] = found->index;
+      }
+
+  free (index);
+
+  return indices;
+}
+
+/* Duplicates obj with its current state, so a freshly built object can
+   be struck many times (or by several threads) without rebuilding it. */
+PSMetalObj *
+ps_metal_obj_copy (const PSMetalObj *obj)
+{
+  PSMetalObj *copy;
+  PSMetalObjNode *inode;
+  int *indices;
+  int i, j, k;
+
+  copy = ps_metal_obj_new (obj->num_nodes);
+  indices = ps_metal_obj_neighbor_indices (obj);
+  if (copy == NULL || indices == NULL)
+    {
+      free (copy);
+      free (indices);
+      return NULL;
+    }
+
+  for (i = 0; i < obj->num_nodes; i++)
+    {
+      inode = ps_metal_obj_node_new (obj->nodes[i]->num_neighbors);
+      if (inode == NULL)
+        {
+          copy->num_nodes = i;
+          ps_metal_obj_free (copy);
+          free (indices);
+          return NULL;
+        }
+
+      inode->anchor = obj->nodes[i]->anchor;
+      inode->pos = obj->nodes[i]->pos;
+      inode->vel = obj->nodes[i]->vel;
+      inode->acc = obj->nodes[i]->acc;
+      copy->nodes[i] = inode;
+    }
+
+  /* Neighbors point into obj; link the same nodes in the copy */
+  for (i = k = 0; i < obj->num_nodes; i++)
+    for (j = 0; j < obj->nodes[i]->num_neighbors; j++)
+      copy->nodes[i]->neighbors[j] = copy->nodes[indices[k++]];
+
+  free (indices);
+
+  return copy;
+}
+
 PSMetalObj *
 ps_metal_obj_new_tube (int height, int circum, double tension)
 {
@@ -362,35 +470,93 @@ ps_metal_obj_new_hypercube (int    dimensions,
 }
 #endif
 
+/* Active set.  Nodes whose motion falls below a floor are put to sleep:
+   ps_metal_obj_perturb () leaves them out until a neighbor moves them
+   again, so the tail of a render only simulates the parts that still
+   ring. */
+
+static void
+ps_metal_obj_node_wake (PSMetalObj *obj, PSMetalObjNode *inode)
+{
+  int j;
+
+  inode->asleep = FALSE;
+  obj->active[obj->num_active++] = inode;
+
+  for (j = 0; j < inode->num_neighbors; j++)
+    inode->neighbors[j]->sleeping_neighbors--;
+}
+
+static void
+ps_metal_obj_node_sleep (PSMetalObjNode *inode)
+{
+  int j;
+
+  inode->asleep = TRUE;
+  inode->vel.x = inode->vel.y = inode->vel.z = 0.0;
+  inode->acc.x = inode->acc.y = inode->acc.z = 0.0;
+
+  for (j = 0; j < inode->num_neighbors; j++)
+    inode->neighbors[j]->sleeping_neighbors++;
+}
+
+static inline void
+ps_metal_obj_node_force (const PSMetalObjNode *inode, vector3 *sum)
+{
+  int j;
+  vector3 dif;
+  double temp;
+
+  sum->x = sum->y = sum->z = 0.0;
+
+  for (j = 0; j < inode->num_neighbors; j++)
+    {
+      dif.x = inode->pos.x - inode->neighbors[j]->pos.x;
+      dif.y = inode->pos.y - inode->neighbors[j]->pos.y;
+      dif.z = inode->pos.z - inode->neighbors[j]->pos.z;
+
+      temp = 1.0 - sqrt ((dif.x * dif.x) + (dif.y * dif.y) + (dif.z * dif.z));
+
+      sum->x += dif.x * temp;
+      sum->y += dif.y * temp;
+      sum->z += dif.z * temp;
+    }
+}
+
+/* A node which moves noticeably wakes its sleeping neighbors; they join
+   the active set from the next step on */
+static inline void
+ps_metal_obj_node_moved (PSMetalObj *obj, PSMetalObjNode *inode,
+                         const vector3 *vel, double speed)
+{
+  int j;
+  double step;
+
+  step = (vel->x * vel->x + vel->y * vel->y + vel->z * vel->z) * speed * speed;
+  if (step > obj->wake_floor)
+    for (j = 0; j < inode->num_neighbors; j++)
+      if (inode->neighbors[j]->asleep)
+        ps_metal_obj_node_wake (obj, inode->neighbors[j]);
+}
+
+/* Nodes move in two passes: all velocities first, then all positions,
+   so the order they are visited in doesn't matter. */
 inline void
 ps_metal_obj_perturb (PSMetalObj *obj, double speed, double damp)
 {
-  int i, j;
+  int i, count;
   vector3 sum;
-  vector3 dif;
   PSMetalObjNode *inode;
-  double temp;
   double sprinps_k;
 
-  for (i = 0; i < obj->num_nodes; i++)
+  count = obj->active ? obj->num_active : obj->num_nodes;
+
+  for (i = 0; i < count; i++)
     {
-      inode = obj->nodes[i];
+      inode = obj->active ? obj->active[i] : obj->nodes[i];
       if (!inode->anchor)
         {
-          sum.x = sum.y = sum.z = 0.0;
-
-          for (j = 0; j < inode->num_neighbors; j++)
-            {
-              dif.x = inode->pos.x - inode->neighbors[j]->pos.x;
-              dif.y = inode->pos.y - inode->neighbors[j]->pos.y;
-              dif.z = inode->pos.z - inode->neighbors[j]->pos.z;
-
-              temp = 1.0 - sqrt ((dif.x * dif.x) + (dif.y * dif.y) + (dif.z * dif.z));
-
-              sum.x += dif.x * temp;
-              sum.y += dif.y * temp;
-              sum.z += dif.z * temp;
-            }
+          ps_metal_obj_node_force (inode, &sum);
 
           sprinps_k = 1.0;
           inode->vel.x = (inode->vel.x + sprinps_k * sum.x * speed) * damp;
@@ -399,15 +565,449 @@ ps_metal_obj_perturb (PSMetalObj *obj, double speed, double damp)
         }
     }
 
-  for (i = 0; i < obj->num_nodes; i++)
+  for (i = 0; i < count; i++)
     {
-      inode = obj->nodes[i];
+      inode = obj->active ? obj->active[i] : obj->nodes[i];
 
       if (!inode->anchor)
         {
           inode->pos.x += inode->vel.x * speed;
           inode->pos.y += inode->vel.y * speed;
           inode->pos.z += inode->vel.z * speed;
+
+          if (inode->sleeping_neighbors > 0)
+            ps_metal_obj_node_moved (obj, inode, &inode->vel, speed);
+        }
+    }
+}
+
+/* Starts tracking the active set, with every node awake.  Returns FALSE
+   if out of memory, in which case all nodes keep being updated. */
+int
+ps_metal_obj_init_active (PSMetalObj *obj)
+{
+  int i;
+
+  free (obj->active);
+  obj->active = (PSMetalObjNode**) malloc (sizeof (PSMetalObjNode*) * obj->num_nodes);
+  if (obj->active == NULL)
+    return FALSE;
+
+  obj->num_active = 0;
+  obj->wake_floor = 0.0;
+  for (i = 0; i < obj->num_nodes; i++)
+    {
+      obj->nodes[i]->asleep = FALSE;
+      obj->nodes[i]->sleeping_neighbors = 0;
+      if (!obj->nodes[i]->anchor)
+        obj->active[obj->num_active++] = obj->nodes[i];
+    }
+
+  return TRUE;
+}
+
+/* Node energy in units of squared velocity: its own, plus what the
+   springs would add within one step */
+static double
+ps_metal_obj_node_energy (const PSMetalObjNode *inode, double speed)
+{
+  vector3 sum;
+
+  ps_metal_obj_node_force (inode, &sum);
+
+  return inode->vel.x * inode->vel.x + inode->vel.y * inode->vel.y +
+    inode->vel.z * inode->vel.z +
+    (sum.x * sum.x + sum.y * sum.y + sum.z * sum.z) * speed * speed;
+}
+
+/* Puts active nodes with less energy than floor to sleep and wakes
+   sleeping ones with more.  Returns the energy of the whole object, 0.0
+   once it is at rest.  Costs about one ps_metal_obj_perturb () call. */
+double
+ps_metal_obj_update_active (PSMetalObj *obj, double speed, double floor)
+{
+  int i, j;
+  double energy, total = 0.0;
+  PSMetalObjNode *inode;
+
+  if (obj->active == NULL)
+    return 0.0;
+
+  obj->wake_floor = floor;
+
+  for (i = 0; i < obj->num_nodes; i++)
+    {
+      inode = obj->nodes[i];
+      if (inode->anchor)
+        continue;
+
+      energy = ps_metal_obj_node_energy (inode, speed);
+      total += energy;
+
+      if (inode->asleep && energy >= floor)
+        ps_metal_obj_node_wake (obj, inode);
+      else if (!inode->asleep && energy < floor)
+        ps_metal_obj_node_sleep (inode);
+    }
+
+  /* Drop the nodes which just fell asleep from the list */
+  for (i = j = 0; i < obj->num_active; i++)
+    if (!obj->active[i]->asleep)
+      obj->active[j++] = obj->active[i];
+  obj->num_active = j;
+
+  return total;
+}
+
+/* Stability.  ps_metal_obj_perturb () is symplectic Euler with unit
+   masses and time step speed.  Around the current positions the springs
+   act as a stiffness matrix K; the update stays bounded as long as
+   speed^2 times the largest eigenvalue of K is below 4.  That eigenvalue
+   is found by power iteration. */
+
+#define PS_STABILITY_ITERATIONS 100
+
+/* out = K u for the spring between a node at d from its neighbor.  A
+   spring of rest length 1 is 2|d| - 1 stiff along d and |d| - 1 across. */
+static inline void
+ps_metal_obj_spring_apply (const vector3 *d, const vector3 *u, vector3 *out)
+{
+  double len, dot;
+
+  len = sqrt (d->x * d->x + d->y * d->y + d->z * d->z);
+  if (len == 0.0)
+    return;
+
+  dot = (d->x * u->x + d->y * u->y + d->z * u->z) / len;
+  out->x += (len - 1.0) * u->x + dot * d->x;
+  out->y += (len - 1.0) * u->y + dot * d->y;
+  out->z += (len - 1.0) * u->z + dot * d->z;
+}
+
+/* ku = K u, one vector3 per node; anchors stay put, so their rows and
+   columns are left out.  indices is from ps_metal_obj_neighbor_indices (). */
+static void
+ps_metal_obj_stiffness_apply (const PSMetalObj *obj, const int *indices,
+                              const vector3 *u, vector3 *ku)
+{
+  const PSMetalObjNode *inode;
+  vector3 d, du;
+  int i, j, k;
+
+  for (i = k = 0; i < obj->num_nodes; i++)
+    {
+      inode = obj->nodes[i];
+      ku[i].x = ku[i].y = ku[i].z = 0.0;
+      if (inode->anchor)
+        {
+          k += inode->num_neighbors;
+          continue;
+        }
+
+      for (j = 0; j < inode->num_neighbors; j++, k++)
+        {
+          d.x = inode->pos.x - inode->neighbors[j]->pos.x;
+          d.y = inode->pos.y - inode->neighbors[j]->pos.y;
+          d.z = inode->pos.z - inode->neighbors[j]->pos.z;
+          du.x = u[i].x - u[indices[k]].x;
+          du.y = u[i].y - u[indices[k]].y;
+          du.z = u[i].z - u[indices[k]].z;
+          ps_metal_obj_spring_apply (&d, &du, &ku[i]);
+        }
+    }
+}
+
+/* Returns the largest speed at which obj can be simulated from its
+   current state, or 0.0 if out of memory.  Anchors don't move, so they
+   are left out of K.  Costs about PS_STABILITY_ITERATIONS
+   ps_metal_obj_perturb () calls. */
+double
+ps_metal_obj_max_speed (const PSMetalObj *obj)
+{
+  vector3 *u, *ku;
+  int *indices;
+  double norm, lambda = 0.0;
+  unsigned int seed = 1;
+  int i, n, iter;
+
+  n = obj->num_nodes;
+  u = (vector3*) malloc (sizeof (vector3) * n);
+  ku = (vector3*) malloc (sizeof (vector3) * n);
+  indices = ps_metal_obj_neighbor_indices (obj);
+  if (u == NULL || ku == NULL || indices == NULL)
+    {
+      free (u);
+      free (ku);
+      free (indices);
+      return 0.0;
+    }
+
+  /* A fixed pseudo-random start, so the estimate is reproducible and
+     has some share of every mode */
+  for (i = 0; i < n; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      u[i].x = obj->nodes[i]->anchor ? 0.0 : (double) (seed >> 16 & 0x7fff) - 16383.5;
+      seed = seed * 1103515245 + 12345;
+      u[i].y = obj->nodes[i]->anchor ? 0.0 : (double) (seed >> 16 & 0x7fff) - 16383.5;
+      seed = seed * 1103515245 + 12345;
+      u[i].z = obj->nodes[i]->anchor ? 0.0 : (double) (seed >> 16 & 0x7fff) - 16383.5;
+    }
+
+  for (iter = 0; iter < PS_STABILITY_ITERATIONS; iter++)
+    {
+      norm = 0.0;
+      for (i = 0; i < n; i++)
+        norm += u[i].x * u[i].x + u[i].y * u[i].y + u[i].z * u[i].z;
+      norm = sqrt (norm);
+      if (norm == 0.0)
+        break;
+      for (i = 0; i < n; i++)
+        {
+          u[i].x /= norm;
+          u[i].y /= norm;
+          u[i].z /= norm;
+        }
+
+      ps_metal_obj_stiffness_apply (obj, indices, u, ku);
+
+      /* u is normalized, so |K u| tends to the largest |eigenvalue| */
+      lambda = 0.0;
+      for (i = 0; i < n; i++)
+        lambda += ku[i].x * ku[i].x + ku[i].y * ku[i].y + ku[i].z * ku[i].z;
+      lambda = sqrt (lambda);
+
+      memcpy (u, ku, sizeof (vector3) * n);
+    }
+
+  free (u);
+  free (ku);
+  free (indices);
+
+  if (lambda <= 0.0)
+    return HUGE_VAL;
+
+  return 2.0 / sqrt (lambda);
+}
+
+/* Other integrators.  Velocity Verlet keeps each node's acceleration and
+   follows the same positions as ps_metal_obj_perturb (), with velocities
+   taken at whole instead of half steps; it has the same stability limit.
+   The implicit step is the Newmark average acceleration method, with the
+   springs linearized around the predicted positions and the resulting
+   system solved by conjugate gradients.  It stays stable at any speed and
+   doesn't damp, but shifts modes far above 1 / speed down in pitch. */
+
+/* Conjugate gradient iterations per implicit step, and the residual
+   relative to the right hand side they stop at */
+#define PS_IMPLICIT_ITERATIONS 32
+#define PS_IMPLICIT_TOLERANCE 1e-6
+
+/* Makes ps_metal_obj_step () use integrator from the current state on.
+   Returns FALSE if out of memory, in which case it falls back to
+   PS_METAL_OBJ_EULER. */
+int
+ps_metal_obj_set_integrator (PSMetalObj *obj, PSMetalObjIntegrator integrator)
+{
+  int i;
+
+  obj->integrator = PS_METAL_OBJ_EULER;
+
+  if (integrator == PS_METAL_OBJ_IMPLICIT)
+    {
+      /* r, p, A p and the new accelerations */
+      if (obj->work == NULL)
+        obj->work = (vector3*) malloc (sizeof (vector3) * 4 * obj->num_nodes);
+      if (obj->neighbor_index == NULL)
+        obj->neighbor_index = ps_metal_obj_neighbor_indices (obj);
+      if (obj->work == NULL || obj->neighbor_index == NULL)
+        return FALSE;
+    }
+
+  for (i = 0; i < obj->num_nodes; i++)
+    if (!obj->nodes[i]->anchor)
+      ps_metal_obj_node_force (obj->nodes[i], &obj->nodes[i]->acc);
+
+  obj->integrator = integrator;
+
+  return TRUE;
+}
+
+static void
+ps_metal_obj_step_verlet (PSMetalObj *obj, double speed, double damp)
+{
+  int i, count;
+  vector3 acc;
+  PSMetalObjNode *inode;
+  double half = 0.5 * speed;
+
+  count = obj->active ? obj->num_active : obj->num_nodes;
+
+  for (i = 0; i < count; i++)
+    {
+      inode = obj->active ? obj->active[i] : obj->nodes[i];
+      if (!inode->anchor)
+        {
+          inode->pos.x += (inode->vel.x + inode->acc.x * half) * speed;
+          inode->pos.y += (inode->vel.y + inode->acc.y * half) * speed;
+          inode->pos.z += (inode->vel.z + inode->acc.z * half) * speed;
+
+          if (inode->sleeping_neighbors > 0)
+            ps_metal_obj_node_moved (obj, inode, &inode->vel, speed);
         }
     }
+
+  for (i = 0; i < count; i++)
+    {
+      inode = obj->active ? obj->active[i] : obj->nodes[i];
+      if (!inode->anchor)
+        {
+          ps_metal_obj_node_force (inode, &acc);
+
+          inode->vel.x = (inode->vel.x + (inode->acc.x + acc.x) * half) * damp;
+          inode->vel.y = (inode->vel.y + (inode->acc.y + acc.y) * half) * damp;
+          inode->vel.z = (inode->vel.z + (inode->acc.z + acc.z) * half) * damp;
+          inode->acc = acc;
+        }
+    }
+}
+
+static inline double
+ps_vectors_dot (const vector3 *a, const vector3 *b, int n)
+{
+  double sum = 0.0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    sum += a[i].x * b[i].x + a[i].y * b[i].y + a[i].z * b[i].z;
+
+  return sum;
+}
+
+/* q = (I + scale K) p */
+static void
+ps_metal_obj_system_apply (const PSMetalObj *obj, double scale,
+                           const vector3 *p, vector3 *q)
+{
+  int i;
+
+  ps_metal_obj_stiffness_apply (obj, obj->neighbor_index, p, q);
+  for (i = 0; i < obj->num_nodes; i++)
+    {
+      q[i].x = p[i].x + scale * q[i].x;
+      q[i].y = p[i].y + scale * q[i].y;
+      q[i].z = p[i].z + scale * q[i].z;
+    }
+}
+
+/* Every node moves, so the active set isn't used; keep its floor at 0.0
+   so no node is put to sleep either */
+static void
+ps_metal_obj_step_implicit (PSMetalObj *obj, double speed, double damp)
+{
+  int i, iter, n = obj->num_nodes;
+  vector3 *r, *p, *q, *acc;
+  double quarter = 0.25 * speed * speed, half = 0.5 * speed;
+  double rs, rs_new, pq, alpha, tol;
+  PSMetalObjNode *inode;
+
+  r = obj->work;
+  p = r + n;
+  q = p + n;
+  acc = q + n;
+
+  /* Predict the positions, then find the accelerations there which
+     satisfy (I + speed^2 / 4 K) acc = F, starting from the old ones */
+  for (i = 0; i < n; i++)
+    {
+      inode = obj->nodes[i];
+      acc[i] = inode->acc;
+      if (!inode->anchor)
+        {
+          inode->pos.x += inode->vel.x * speed + inode->acc.x * quarter;
+          inode->pos.y += inode->vel.y * speed + inode->acc.y * quarter;
+          inode->pos.z += inode->vel.z * speed + inode->acc.z * quarter;
+        }
+    }
+
+  ps_metal_obj_system_apply (obj, quarter, acc, q);
+  for (i = 0; i < n; i++)
+    {
+      inode = obj->nodes[i];
+      if (inode->anchor)
+        r[i].x = r[i].y = r[i].z = 0.0;
+      else
+        {
+          ps_metal_obj_node_force (inode, &r[i]);
+          r[i].x -= q[i].x;
+          r[i].y -= q[i].y;
+          r[i].z -= q[i].z;
+        }
+      p[i] = r[i];
+    }
+
+  rs = ps_vectors_dot (r, r, n);
+  tol = rs * PS_IMPLICIT_TOLERANCE * PS_IMPLICIT_TOLERANCE;
+  for (iter = 0; iter < PS_IMPLICIT_ITERATIONS && rs > tol; iter++)
+    {
+      ps_metal_obj_system_apply (obj, quarter, p, q);
+      pq = ps_vectors_dot (p, q, n);
+      /* Only compressed springs can make the system indefinite */
+      if (pq <= 0.0)
+        break;
+      alpha = rs / pq;
+
+      for (i = 0; i < n; i++)
+        {
+          acc[i].x += alpha * p[i].x;
+          acc[i].y += alpha * p[i].y;
+          acc[i].z += alpha * p[i].z;
+          r[i].x -= alpha * q[i].x;
+          r[i].y -= alpha * q[i].y;
+          r[i].z -= alpha * q[i].z;
+        }
+
+      rs_new = ps_vectors_dot (r, r, n);
+      for (i = 0; i < n; i++)
+        {
+          p[i].x = r[i].x + rs_new / rs * p[i].x;
+          p[i].y = r[i].y + rs_new / rs * p[i].y;
+          p[i].z = r[i].z + rs_new / rs * p[i].z;
+        }
+      rs = rs_new;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      inode = obj->nodes[i];
+      if (inode->anchor)
+        continue;
+
+      inode->pos.x += acc[i].x * quarter;
+      inode->pos.y += acc[i].y * quarter;
+      inode->pos.z += acc[i].z * quarter;
+      inode->vel.x = (inode->vel.x + (inode->acc.x + acc[i].x) * half) * damp;
+      inode->vel.y = (inode->vel.y + (inode->acc.y + acc[i].y) * half) * damp;
+      inode->vel.z = (inode->vel.z + (inode->acc.z + acc[i].z) * half) * damp;
+      inode->acc = acc[i];
+    }
+}
+
+/* One step of the integrator chosen by ps_metal_obj_set_integrator () */
+void
+ps_metal_obj_step (PSMetalObj *obj, double speed, double damp)
+{
+  switch (obj->integrator)
+    {
+    case PS_METAL_OBJ_VERLET:
+      ps_metal_obj_step_verlet (obj, speed, damp);
+      break;
+    case PS_METAL_OBJ_IMPLICIT:
+      ps_metal_obj_step_implicit (obj, speed, damp);
+      break;
+    case PS_METAL_OBJ_EULER:
+    default:
+      ps_metal_obj_perturb (obj, speed, damp);
+      break;
+    }
 }
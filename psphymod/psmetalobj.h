@@ -36,14 +36,36 @@ struct _PSMetalObjNode
   int anchor;
   vector3  pos;
   vector3  vel;
+  vector3  acc;  /* at pos, kept by the Verlet and implicit steps */
+
+  /* Active set bookkeeping, see ps_metal_obj_update_active () */
+  int asleep;
+  int sleeping_neighbors;
 
   int                    num_neighbors;
   struct _PSMetalObjNode *neighbors[1];
 } PSMetalObjNode;
 
+typedef enum
+{
+  PS_METAL_OBJ_EULER,    /* semi-implicit Euler, ps_metal_obj_perturb () */
+  PS_METAL_OBJ_VERLET,   /* velocity Verlet */
+  PS_METAL_OBJ_IMPLICIT  /* Newmark average acceleration, linearized */
+} PSMetalObjIntegrator;
+
 typedef
 struct _PSMetalObj
 {
+  /* Moving nodes, or NULL to update all of them */
+  int            num_active;
+  PSMetalObjNode **active;
+  double         wake_floor;
+
+  /* Used by ps_metal_obj_step (), see ps_metal_obj_set_integrator () */
+  PSMetalObjIntegrator integrator;
+  vector3        *work;
+  int            *neighbor_index;
+
   int            num_nodes;
   PSMetalObjNode *nodes[1];
 } PSMetalObj;
@@ -51,11 +73,17 @@ struct _PSMetalObj
 void ps_metal_obj_node_free (PSMetalObjNode *n);
 PSMetalObj *ps_metal_obj_new (int size);
 void ps_metal_obj_free (PSMetalObj *obj);
+PSMetalObj *ps_metal_obj_copy (const PSMetalObj *obj);
 PSMetalObj *ps_metal_obj_new_tube (int height, int circum, double tension);
 PSMetalObj *ps_metal_obj_new_rod (int height, double tension);
 PSMetalObj *ps_metal_obj_new_plane (int length, int width, double tension);
 // PSMetalObj *ps_metal_obj_new_hypercube (int dimensions, int size, double tension);
 void ps_metal_obj_perturb (PSMetalObj *obj, double speed, double damp);
+int ps_metal_obj_init_active (PSMetalObj *obj);
+double ps_metal_obj_update_active (PSMetalObj *obj, double speed, double floor);
+double ps_metal_obj_max_speed (const PSMetalObj *obj);
+int ps_metal_obj_set_integrator (PSMetalObj *obj, PSMetalObjIntegrator integrator);
+void ps_metal_obj_step (PSMetalObj *obj, double speed, double damp);
 
 #ifdef __cplusplus
 }
@@ -27,7 +27,7 @@
 
 char *device = "plughw:0,0";	/* playback device */
 snd_pcm_format_t format = SND_PCM_FORMAT_S16;	/* sample format */
-unsigned int rate = 44100;	/* stream rate */
+unsigned int rate;	/* stream rate */
 unsigned int channels = 1;	/* count of channels */
 
 snd_output_t *output = NULL;
@@ -35,7 +35,7 @@ snd_pcm_t *handle;
 
 static int alsa_open(void)
 {
-    unsigned int rrate = rate;
+    unsigned int rrate = rate = conf_rate;
     snd_pcm_uframes_t bufsize;
     int err;
 
@@ -74,7 +74,7 @@ static int alsa_open(void)
     }
     if ((float) rrate / (float) rate > 1.1
 	|| (float) rrate / (float) rate < .9) {
-	fprintf(stderr, "Supported rate is too far from 44100Hz\n");
+	fprintf(stderr, "Supported rate is too far from %uHz\n", rate);
 	return G_MININT;
     }
     if ((err =
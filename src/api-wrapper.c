@@ -20,25 +20,254 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include "api-wrapper.h"
+#include "trace.h"
+
+/* Steps between updates of the active set (a power of two) */
+#define PS_ACTIVE_INTERVAL 64
+/* Nodes sleep while they hold less than this share of the object's peak
+   energy between them, -180 dB */
+#define PS_SLEEP_RATIO 1e-18
+/* Renders stop once the object's energy is this far below its peak,
+   -160 dB.  What the output still holds then is the high-pass filter
+   settling, well below 16-bit resolution.  Sleeping nodes keep their
+   energy, so this must be above PS_SLEEP_RATIO. */
+#define PS_QUIET_RATIO 1e-16
+/* A damped object gains no energy after the strike, except what an
+   object built under compression (tension below 1) releases as it
+   buckles, which is of the order of a unit force on every node.  Allow
+   for that and for the measure not being exact before calling the render
+   diverged. */
+#define PS_UNSTABLE_GROWTH 1e4
+/* The stable speed is exact only for small motions around the built
+   shape; keep clear of it */
+#define PS_STABLE_MARGIN 0.9
+
+/* Internal samples the upsampler interpolates from, an even number */
+#define PS_UPSAMPLE_TAPS 16
+/* The physics rate is only divided while the highest mode turns by at
+   most this many radians per step.  The step raises that mode's pitch
+   by 12 cents there, and the lower modes by much less. */
+#define PS_DIVISOR_MAX_ANGLE 0.4
+
+/* A snapshot buffer is free for the renderer or the viewer to take while
+   its index is in latest; FRESH marks one not read yet */
+#define PS_SNAPSHOT_FRESH 4
+
+struct _PSSnapshots
+{
+    gint capacity;
+    gint num_nodes[3];
+    vector3 *pos[3];
+    gint latest;		/* shared, only swapped atomically */
+    gint writing;		/* renderer's own */
+    gint reading;		/* viewer's own */
+};
+
+PSSnapshots *
+ps_snapshots_new(gint num_nodes)
+{
+    PSSnapshots *snap;
+    gint i;
+
+    snap = g_new0(PSSnapshots, 1);
+    snap->capacity = num_nodes;
+    for (i = 0; i < 3; i++)
+	snap->pos[i] = g_new(vector3, MAX(num_nodes, 1));
+    snap->writing = 0;
+    snap->latest = 1;
+    snap->reading = 2;
+
+    return snap;
+}
+
+void
+ps_snapshots_free(PSSnapshots * snap)
+{
+    gint i;
+
+    if (snap == NULL)
+	return;
+
+    for (i = 0; i < 3; i++)
+	g_free(snap->pos[i]);
+    g_free(snap);
+}
+
+/* Puts index (with flags) into latest and returns what was there */
+static gint
+ps_snapshots_swap(PSSnapshots * snap, gint index)
+{
+    gint old;
+
+    do
+	old = g_atomic_int_get(&snap->latest);
+    while (!g_atomic_int_compare_and_exchange(&snap->latest, old, index));
+
+    return old;
+}
+
+void
+ps_snapshots_publish(PSSnapshots * snap, const PSMetalObj * obj)
+{
+    vector3 *pos = snap->pos[snap->writing];
+    gint i, n;
+
+    n = MIN(obj->num_nodes, snap->capacity);
+    for (i = 0; i < n; i++)
+	pos[i] = obj->nodes[i]->pos;
+    snap->num_nodes[snap->writing] = n;
+
+    snap->writing = ps_snapshots_swap(snap, snap->writing | PS_SNAPSHOT_FRESH) &
+	~PS_SNAPSHOT_FRESH;
+}
+
+const vector3 *
+ps_snapshots_read(PSSnapshots * snap, gint * num_nodes)
+{
+    if (!(g_atomic_int_get(&snap->latest) & PS_SNAPSHOT_FRESH))
+	return NULL;
+
+    snap->reading = ps_snapshots_swap(snap, snap->reading) & ~PS_SNAPSHOT_FRESH;
+    *num_nodes = snap->num_nodes[snap->reading];
+
+    return snap->pos[snap->reading];
+}
+
+/* How far the output has fallen from its loudest, in 1/100 dB */
+static gint
+ps_render_decay(gdouble lowpass, gdouble maxamp)
+{
+    if (maxamp <= 0.0)
+	return 0;
+    if (lowpass <= maxamp * 1e-50)
+	return 100000;
+
+    return (gint) (-2000.0 * log10(lowpass / maxamp));
+}
+
+static gfloat
+ps_render_fraction(gint samples, gint len, gint decay, gdouble att)
+{
+    gfloat done = len > 0 ? (gfloat) samples / len : 1.0;
+
+    if (att < 0)
+	done = MAX(done, decay / (-100.0 * att));
+
+    return CLAMP(done, 0.0, 1.0);
+}
+
+gfloat
+ps_render_progress_fraction(PSRenderProgress * progress, gint len, gdouble att)
+{
+    gint decay = g_atomic_int_get(&progress->decay);
+
+    return ps_render_fraction(g_atomic_int_get(&progress->samples), len,
+			      decay, att);
+}
+
+/* Polyphase filter for upsampling by divisor: a Blackman windowed sinc,
+   each phase normalized to unit gain.  The output (p + frac) / divisor
+   of a step after internal sample n is coef[p] applied to the
+   PS_UPSAMPLE_TAPS internal samples up to n + PS_UPSAMPLE_TAPS / 2,
+   oldest first. */
+static void
+ps_upsample_init(gdouble coef[][PS_UPSAMPLE_TAPS], gint divisor,
+		 gdouble frac)
+{
+    gint p, k;
+    gdouble t, w, sum, width = PS_UPSAMPLE_TAPS / 2 * divisor;
+
+    for (p = 0; p < divisor; p++) {
+	sum = 0.0;
+	for (k = 0; k < PS_UPSAMPLE_TAPS; k++) {
+	    /* Distance of the sample from the output, in output samples */
+	    t = (PS_UPSAMPLE_TAPS / 2 - 1 - k) * divisor + p + frac;
+	    w = 0.42 + 0.5 * cos(G_PI * t / width) +
+		0.08 * cos(2.0 * G_PI * t / width);
+	    coef[p][k] = t == 0.0 ? 1.0 :
+		w * sin(G_PI * t / divisor) / (G_PI * t / divisor);
+	    sum += coef[p][k];
+	}
+	for (k = 0; k < PS_UPSAMPLE_TAPS; k++)
+	    coef[p][k] /= sum;
+    }
+}
+
+static inline gdouble
+ps_upsample(const gdouble * hist, const gdouble * coef)
+{
+    gdouble sum = 0.0;
+    gint k;
+
+    for (k = 0; k < PS_UPSAMPLE_TAPS; k++)
+	sum += hist[k] * coef[k];
+
+    return sum;
+}
+
+/* The highest mode turns by 2 * speed / max_speed radians per step */
+static gint
+ps_render_divisor(gdouble speed, gdouble max_speed, gint most)
+{
+    gint divisor;
+
+    if (most <= 1 || speed <= 0.0 || max_speed <= 0.0)
+	return 1;
+
+    divisor = (gint) MIN(PS_DIVISOR_MAX_ANGLE * max_speed / (2.0 * speed),
+			 PS_RATE_DIVISOR_MAX);
+
+    return CLAMP(divisor, 1, MIN(most, PS_RATE_DIVISOR_MAX));
+}
 
 /* Now len means _maximal_ lenght if the given attenuation will not be reached;
    for disabling stopping at given attenuation, use attenuation = 0.0.
    Attenuation is given in dB, att = 60.0 means render will be stopped after
-   the mean amplitude reach the value of -60 dB. */
-static guint
+   the mean amplitude reach the value of -60 dB.
+   With opts->sink set, samples are written to a block buffer which is
+   flushed to the sink whenever it fills up, and are left unnormalized,
+   as they are with opts->raw.
+   Independently of att, the render ends early once the whole object has
+   come to rest, and nodes which have stopped moving are not simulated.
+   Snapshots for opts->snapshots are taken as often as well, at most.
+   The energy is checked as often, and a render which turns into NaNs or
+   keeps gaining energy is abandoned with PS_RENDER_UNSTABLE.
+   opts->progress is updated as often too; cb, if given, every 1024 samples.
+   max_speed is the object's stable limit, see opts->step.
+   With opts->divisor the object is stepped once every divisor samples
+   and the output node is interpolated in between.  The upsampler looks
+   PS_UPSAMPLE_TAPS / 2 steps ahead, so the physics runs that far ahead
+   of the output. */
+static gint
 ps_metal_obj_render(gint rate, PSMetalObj * obj, gint innode, gint outnode,
-		    gdouble speed, gdouble damp, gint compress,
+		    gdouble max_speed, gdouble speed, gdouble damp, gint compress,
 		    gdouble velocity, gint len, gdouble * samples,
-		    PSPercentCallback * cb, gdouble att, gpointer userdata)
+		    PSPercentCallback * cb, gdouble att, gpointer userdata,
+		    PSRenderOptions * opts)
 {
-    gint i, real_len;
+    gint i, s, substeps = 1, real_len, next_snapshot = 0;
+    gint divisor = 1, phase = 0, newest = 0, first;
+    gdouble to_step;
+    gdouble coef[PS_RATE_DIVISOR_MAX][PS_UPSAMPLE_TAPS];
+    gdouble hist[2 * PS_UPSAMPLE_TAPS];	/* doubled for a flat window */
     gdouble maxvol;
     gdouble stasis;
     gdouble sample, hipass, hipass_coeff, lowpass_coeff, lowpass, maxamp;
-
-    gdouble curr_att = 0.0;
+    gdouble block[PS_RENDER_BLOCK];
+    gdouble *out;
+    gint mask, flushed = 0;
+    gint64 node_steps = 0, block_start = 0, span;
+    PSRenderProgress *progress = opts ? opts->progress : NULL;
+    gdouble att_ratio;
+    gint decay;
+    PSRenderStop stop = PS_STOP_LENGTH;
+    PSBlockCallback *sink = opts ? opts->sink : NULL;
+
+    gdouble energy, peak_energy = 0.0, energy_limit = 0.0, sleep_floor;
+    PSMetalObjIntegrator integrator = opts ? opts->integrator : PS_METAL_OBJ_EULER;
 
     if (compress) {
 	stasis = obj->nodes[outnode]->pos.z;
@@ -51,129 +280,366 @@ ps_metal_obj_render(gint rate, PSMetalObj * obj, gint innode, gint outnode,
     hipass = lowpass = maxamp = 0.0;
     hipass_coeff = pow(0.5, 5.0 / rate);
     lowpass_coeff = 1 - 20.0 / rate;	/* 50 ms integrator */
-    damp = pow(0.5, 1.0 / (damp * rate));
+
+    /* Steps as long as speed makes them at the reference rate, taken at
+       rate / divisor */
+    to_step = (gdouble) PS_REFERENCE_RATE / rate;
+    speed *= to_step;
+    if (opts && integrator != PS_METAL_OBJ_IMPLICIT)
+	divisor = ps_render_divisor(speed, max_speed, opts->divisor);
+    speed *= divisor;
+
+    /* 0.0 means the limit couldn't be estimated */
+    max_speed = max_speed > 0.0 ? max_speed * PS_STABLE_MARGIN : speed;
+    if (integrator == PS_METAL_OBJ_IMPLICIT)
+	;			/* stable at any speed */
+    else if (opts && opts->step == PS_STEP_CLAMP)
+	speed = MIN(speed, max_speed);
+    else if ((!opts || opts->step == PS_STEP_SUBSTEP) && speed > max_speed)
+	substeps = (gint) ceil(speed / max_speed);
+    if (opts)
+	substeps = MAX(substeps, opts->substeps);
+    /* Same motion in smaller steps */
+    speed /= substeps;
+    if (opts) {
+	/* In the caller's terms */
+	opts->max_speed = max_speed / (to_step * divisor);
+	opts->substeps = substeps;
+	opts->divisor = divisor;
+    }
+
+    damp = pow(0.5, 1.0 / (damp * rate / divisor * substeps));
+
+    /* Either write straight into samples or wrap around the block buffer */
+    out = sink ? block : samples;
+    mask = sink ? PS_RENDER_BLOCK - 1 : -1;
+
+    ps_metal_obj_init_active(obj);
+    ps_metal_obj_set_integrator(obj, integrator);
+
+    /* Decay is tested on amplitudes, which spares a log10 per sample */
+    att_ratio = att < 0 ? pow(10.0, att / 20.0) : 0.0;
+
+    /* Sample i is taken after i + 1 steps at the output rate.  A step
+       divisor times as long sets the object going (divisor - 1) / 2
+       samples earlier, since Euler takes the initial velocity half a
+       step before the start; so in output samples from internal sample
+       0, sample i is at i + 1 - (divisor - 1) / 2 - divisor, which is
+       first + i + frac.  Fill the upsampler up to PS_UPSAMPLE_TAPS / 2
+       steps ahead of the internal sample before the first output, less
+       the one the loop takes at once if that falls on phase 0. */
+    if (divisor > 1) {
+	first = (gint) floor((3.0 - 3.0 * divisor) / 2.0);
+	ps_upsample_init(coef, divisor, divisor % 2 ? 0.0 : 0.5);
+	phase = first - (gint) floor((gdouble) first / divisor) * divisor;
+	memset(hist, 0, sizeof(hist));
+	/* first is never positive, so this rounds up */
+	for (i = 0; i < first / divisor + PS_UPSAMPLE_TAPS / 2; i++) {
+	    for (s = 0; s < substeps; s++)
+		ps_metal_obj_step(obj, speed, damp);
+	    node_steps += (gint64) substeps * obj->num_nodes;
+	    sample = (compress ? obj->nodes[outnode]->pos.z :
+		      obj->nodes[outnode]->pos.x) - stasis;
+	    hist[newest] = hist[newest + PS_UPSAMPLE_TAPS] = sample;
+	    newest = (newest + 1) & (PS_UPSAMPLE_TAPS - 1);
+	}
+    }
 
     maxvol = 0.001;
     for (i = 0; i < len; i++) {
-	ps_metal_obj_perturb(obj, speed, damp);
+	if (!(i & (PS_ACTIVE_INTERVAL - 1))) {
+	    if (progress || (cb && !(i & 1023))) {
+		decay = ps_render_decay(lowpass, maxamp);
+		if (progress) {
+		    g_atomic_int_set(&progress->decay, decay);
+		    g_atomic_int_set(&progress->samples, i);
+		}
+		if (cb && !(i & 1023))
+		    cb(ps_render_fraction(i, len, decay, att), userdata);
+	    }
+	    /* One span per block of output */
+	    if (!(i & (PS_RENDER_BLOCK - 1))) {
+		if (i > 0)
+		    trace_end("simulate", block_start);
+		block_start = trace_begin();
+	    }
+	    /* The implicit step moves every node anyway */
+	    sleep_floor = obj->integrator == PS_METAL_OBJ_IMPLICIT ? 0.0 :
+		peak_energy * PS_SLEEP_RATIO / obj->num_nodes;
+	    energy = ps_metal_obj_update_active(obj, speed, sleep_floor);
+	    if (i == 0)
+		energy_limit = MAX(energy, obj->num_nodes * speed * speed) *
+		    PS_UNSTABLE_GROWTH;
+	    if (!isfinite(energy) || energy > energy_limit) {
+		if (opts) {
+		    opts->stop = PS_STOP_UNSTABLE;
+		    opts->node_steps = node_steps;
+		}
+		trace_end("simulate", block_start);
+		return PS_RENDER_UNSTABLE;
+	    }
+	    if (opts && opts->snapshots && i >= next_snapshot) {
+		ps_snapshots_publish(opts->snapshots, obj);
+		next_snapshot = i + opts->snapshot_interval;
+	    }
+	    if (energy > peak_energy)
+		peak_energy = energy;
+	    else if (energy <= peak_energy * PS_QUIET_RATIO) {
+		stop = PS_STOP_QUIET;
+		break;
+	    }
+	}
 
-	if (compress)
-	    sample = obj->nodes[outnode]->pos.z - stasis;
-	else
-	    sample = obj->nodes[outnode]->pos.x - stasis;
+	if (phase == 0) {
+	    for (s = 0; s < substeps; s++)
+		ps_metal_obj_step(obj, speed, damp);
+	    node_steps += (gint64) substeps *
+		(obj->active ? obj->num_active : obj->num_nodes);
+
+	    if (compress)
+		sample = obj->nodes[outnode]->pos.z - stasis;
+	    else
+		sample = obj->nodes[outnode]->pos.x - stasis;
+	}
+	if (divisor > 1) {
+	    if (phase == 0) {
+		hist[newest] = hist[newest + PS_UPSAMPLE_TAPS] = sample;
+		newest = (newest + 1) & (PS_UPSAMPLE_TAPS - 1);
+	    }
+	    /* The window starts at the oldest sample, the next to go */
+	    sample = ps_upsample(hist + newest, coef[phase]);
+	    if (++phase == divisor)
+		phase = 0;
+	}
 
 	hipass = hipass_coeff * hipass + (1.0 - hipass_coeff) * sample;
-	samples[i] = sample - hipass;
+	sample -= hipass;
+
+	if (sink && i > 0 && !(i & mask)) {
+	    span = trace_begin();
+	    sink(block, PS_RENDER_BLOCK, opts->sink_data);
+	    trace_end("sink", span);
+	    flushed = i;
+	}
+	out[i & mask] = sample;
 
-	if (fabs(samples[i]) > maxvol)
-	    maxvol = fabs(samples[i]);
+	if (fabs(sample) > maxvol)
+	    maxvol = fabs(sample);
 
 	lowpass =
 	    lowpass_coeff * lowpass + (1.0 -
-				       lowpass_coeff) * fabs(samples[i]);
+				       lowpass_coeff) * fabs(sample);
 	if (maxamp < lowpass)
 	    maxamp = lowpass;
 
-	if (att < 0) {
-	    if (maxamp > 0.0)
-		curr_att = 20 * log10(lowpass / maxamp);
-
-	    if (!(i & 1023))
-		if (cb != NULL) {
-		    float p1, p2;
-
-		    p1 = ((float) i) / len;
-		    p2 = curr_att / att;
-		    cb(MAX(p1, p2), userdata);
-		}
-
-	    if (curr_att <= att)
-		break;
-	} else {
-	    if (!(i & 1023))
-		if (cb != NULL)
-		    cb(((float) i) / len, userdata);
+	if (att < 0 && maxamp > 0.0 && lowpass <= maxamp * att_ratio) {
+	    stop = PS_STOP_ATTENUATION;
+	    break;
 	}
     }
     real_len = i;
+    if (progress)
+	g_atomic_int_set(&progress->samples, real_len);
+    trace_end("simulate", block_start);
+
+    if (opts) {
+	opts->peak = maxvol;
+	opts->stop = stop;
+	opts->node_steps = node_steps;
+    }
 
+    if (sink) {
+	if (real_len > flushed) {
+	    span = trace_begin();
+	    sink(block, real_len - flushed, opts->sink_data);
+	    trace_end("sink", span);
+	}
+	return real_len;
+    }
+    if (opts && opts->raw)
+	return real_len;
+
+    span = trace_begin();
     maxvol = 1.0 / maxvol;
     for (i = 0; i < real_len; i++)
 	samples[i] *= maxvol;
+    trace_end("normalize", span);
 
     return real_len;
 }
 
-guint
-ps_metal_obj_render_tube(gint rate, gint height, gint circum,
-			 gdouble tension, gdouble speed, gdouble damp,
-			 gint compress, gdouble velocity, gint len,
-			 gdouble * samples, PSPercentCallback * cb,
-			 gdouble att, gpointer userdata)
+/* Where each topology is struck and listened to */
+struct _PSMetalTopology
 {
     PSMetalObj *obj;
     gint innode, outnode;
-    guint lgth;
+    gdouble max_speed;
+};
+
+static PSMetalTopology *
+ps_metal_topology_new(PSMetalObj * obj, gint innode, gint outnode)
+{
+    PSMetalTopology *topo;
 
-    obj = ps_metal_obj_new_tube(height, circum, tension);
+    if (obj == NULL)
+	return NULL;
 
-    innode = circum + circum / 2;
-    outnode = (height - 2) * circum;
+    topo = g_new(PSMetalTopology, 1);
+    topo->obj = obj;
+    topo->innode = innode;
+    topo->outnode = outnode;
+    topo->max_speed = ps_metal_obj_max_speed(obj);
+
+    return topo;
+}
+
+PSMetalTopology *
+ps_metal_topology_new_tube(gint height, gint circum, gdouble tension)
+{
+    gint64 start = trace_begin();
+    PSMetalTopology *topo;
+
+    topo = ps_metal_topology_new(ps_metal_obj_new_tube(height, circum, tension),
+				 circum + circum / 2, (height - 2) * circum);
+    trace_end("build", start);
+
+    return topo;
+}
+
+PSMetalTopology *
+ps_metal_topology_new_rod(gint length, gdouble tension)
+{
+    gint64 start = trace_begin();
+    PSMetalTopology *topo;
+
+    topo = ps_metal_topology_new(ps_metal_obj_new_rod(length, tension),
+				 1, length - 2);
+    trace_end("build", start);
+
+    return topo;
+}
+
+PSMetalTopology *
+ps_metal_topology_new_plane(gint length, gint width, gdouble tension)
+{
+    gint64 start = trace_begin();
+    PSMetalTopology *topo;
+
+    topo = ps_metal_topology_new(ps_metal_obj_new_plane(length, width, tension),
+				 1, (length - 1) * width - 1);
+    trace_end("build", start);
+
+    return topo;
+}
+
+gdouble
+ps_metal_topology_max_speed(const PSMetalTopology * topo)
+{
+    return topo->max_speed;
+}
+
+void
+ps_metal_topology_free(PSMetalTopology * topo)
+{
+    if (topo == NULL)
+	return;
+
+    ps_metal_obj_free(topo->obj);
+    g_free(topo);
+}
+
+/* The topology itself stays at rest; every strike works on a copy */
+gint
+ps_metal_topology_render(const PSMetalTopology * topo, gint rate,
+			 gdouble speed, gdouble damp, gint compress,
+			 gdouble velocity, gint len, gdouble * samples,
+			 PSPercentCallback * cb, gdouble att,
+			 gpointer userdata, PSRenderOptions * opts)
+{
+    PSMetalObj *obj;
+    gint lgth;
+    gint64 start = trace_begin();
+
+    obj = ps_metal_obj_copy(topo->obj);
+    trace_end("copy", start);
+    if (obj == NULL)
+	return 0;
 
     lgth =
-	ps_metal_obj_render(rate, obj, innode, outnode, speed, damp,
-			    compress, velocity, len, samples, cb, att,
-			    userdata);
+	ps_metal_obj_render(rate, obj, topo->innode, topo->outnode,
+			    topo->max_speed, speed, damp, compress, velocity, len, samples, cb, att,
+			    userdata, opts);
 
     ps_metal_obj_free(obj);
     return lgth;
 }
 
-guint
-ps_metal_obj_render_rod(int rate, int length, double tension, double speed,
-			double damp, int compress, double velocity,
-			int len, double *samples, PSPercentCallback * cb,
-			gdouble att, gpointer userdata)
+/* One-off strikes render the freshly built object directly */
+static gint
+ps_metal_topology_render_once(PSMetalTopology * topo, gint rate,
+			      gdouble speed, gdouble damp, gint compress,
+			      gdouble velocity, gint len, gdouble * samples,
+			      PSPercentCallback * cb, gdouble att,
+			      gpointer userdata, PSRenderOptions * opts)
 {
-    PSMetalObj *obj;
-    gint innode, outnode;
-    guint lgth;
-
-    obj = ps_metal_obj_new_rod(length, tension);
+    gint lgth;
 
-    innode = 1;
-    outnode = length - 2;
+    if (topo == NULL)
+	return 0;
 
     lgth =
-	ps_metal_obj_render(rate, obj, innode, outnode, speed, damp,
-			    compress, velocity, len, samples, cb, att,
-			    userdata);
+	ps_metal_obj_render(rate, topo->obj, topo->innode, topo->outnode,
+			    topo->max_speed, speed, damp, compress, velocity, len, samples, cb,
+			    att, userdata, opts);
 
-    ps_metal_obj_free(obj);
+    ps_metal_topology_free(topo);
     return lgth;
 }
 
-guint
+gint
+ps_metal_obj_render_tube(gint rate, gint height, gint circum,
+			 gdouble tension, gdouble speed, gdouble damp,
+			 gint compress, gdouble velocity, gint len,
+			 gdouble * samples, PSPercentCallback * cb,
+			 gdouble att, gpointer userdata, PSRenderOptions * opts)
+{
+    return ps_metal_topology_render_once(ps_metal_topology_new_tube(height, circum, tension),
+					 rate, speed, damp, compress, velocity,
+					 len, samples, cb, att, userdata, opts);
+}
+
+gint
+ps_metal_obj_render_rod(int rate, int length, double tension, double speed,
+			double damp, int compress, double velocity,
+			int len, double *samples, PSPercentCallback * cb,
+			gdouble att, gpointer userdata, PSRenderOptions * opts)
+{
+    return ps_metal_topology_render_once(ps_metal_topology_new_rod(length, tension),
+					 rate, speed, damp, compress, velocity,
+					 len, samples, cb, att, userdata, opts);
+}
+
+gint
 ps_metal_obj_render_plane(gint rate, gint length, gint width,
 			  gdouble tension, gdouble speed, gdouble damp,
 			  gint compress, gdouble velocity, gint len,
 			  gdouble * samples, PSPercentCallback * cb,
-			  gdouble att, gpointer userdata)
+			  gdouble att, gpointer userdata, PSRenderOptions * opts)
 {
-    PSMetalObj *obj;
-    gint innode, outnode;
-    guint lgth;
-
-    obj = ps_metal_obj_new_plane(length, width, tension);
-
-    innode = 1;
-    outnode = (length - 1) * width - 1;
+    return ps_metal_topology_render_once(ps_metal_topology_new_plane(length, width, tension),
+					 rate, speed, damp, compress, velocity,
+					 len, samples, cb, att, userdata, opts);
+}
 
-    lgth =
-	ps_metal_obj_render(rate, obj, innode, outnode, speed, damp,
-			    compress, velocity, len, samples, cb, att,
-			    userdata);
+void
+ps_render_interpolate(const gdouble * a, gint na, gdouble va,
+		      const gdouble * b, gint nb, gdouble vb, gdouble v,
+		      gdouble * out, gint n)
+{
+    gdouble t = (v - va) / (vb - va);
+    gint i;
 
-    ps_metal_obj_free(obj);
-    return lgth;
+    /* Past its end a render is silent */
+    for (i = 0; i < n; i++)
+	out[i] = (1.0 - t) * (i < na ? a[i] : 0.0) + t * (i < nb ? b[i] : 0.0);
 }
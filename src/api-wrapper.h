@@ -30,10 +30,137 @@ extern "C" {
 #include <glib.h>
 
 typedef void PSPercentCallback (gfloat percent, gpointer userdata);
+typedef void PSBlockCallback (const gdouble *block, gint n, gpointer userdata);
 
-guint ps_metal_obj_render_tube (gint rate, gint height, gint circum, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att, gpointer userdata);
-guint ps_metal_obj_render_rod (gint rate, gint length, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att,  gpointer userdata);
-guint ps_metal_obj_render_plane (gint rate, gint length, gint width, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att,  gpointer userdata);
+/* Largest block handed to a PSBlockCallback */
+#define PS_RENDER_BLOCK 4096
+
+/* speed is the step per sample at this rate; at other rates it is scaled
+   to match, so an object sounds the same at any rate */
+#define PS_REFERENCE_RATE 44100
+/* Most the physics rate is divided by, see PSRenderOptions.divisor */
+#define PS_RATE_DIVISOR_MAX 8
+
+/* What to do when speed is too high for the object to stay stable */
+typedef enum
+{
+    PS_STEP_SUBSTEP,	/* split every step into as many as needed */
+    PS_STEP_CLAMP,	/* lower speed to the limit, which changes the sound */
+    PS_STEP_AS_GIVEN	/* run as asked, and risk PS_RENDER_UNSTABLE */
+} PSStepMode;
+
+/* Why a render ended before len samples, or didn't */
+typedef enum
+{
+    PS_STOP_LENGTH,		/* rendered all len samples */
+    PS_STOP_ATTENUATION,	/* the output fell by att dB */
+    PS_STOP_QUIET,		/* the object came to rest */
+    PS_STOP_UNSTABLE		/* returned PS_RENDER_UNSTABLE */
+} PSRenderStop;
+
+/* How far a running render has got.  The renderer updates it every 64
+   samples; another thread can poll it at whatever rate suits it, instead
+   of taking a PSPercentCallback on the rendering thread. */
+typedef struct _PSRenderProgress
+{
+    volatile gint	samples;	/* rendered so far */
+    volatile gint	decay;		/* fall of the output from its
+					   loudest, in 1/100 dB */
+} PSRenderProgress;
+
+/* 0.0 to 1.0, for a render of len samples stopping at att dB */
+gfloat ps_render_progress_fraction (PSRenderProgress *progress, gint len, gdouble att);
+
+/* Node positions handed from a render to a viewer, e.g. to animate the
+   object while it rings.  It is a triple buffer: the renderer fills one
+   copy, the viewer reads another, and the third holds the newest complete
+   snapshot.  Either side swaps its copy for the third one atomically, so
+   neither ever waits for the other. */
+typedef struct _PSSnapshots PSSnapshots;
+
+/* Holds up to num_nodes positions per snapshot */
+PSSnapshots *ps_snapshots_new (gint num_nodes);
+void ps_snapshots_free (PSSnapshots *snap);
+/* Renderer side */
+void ps_snapshots_publish (PSSnapshots *snap, const PSMetalObj *obj);
+/* Viewer side: the newest snapshot, in the object's node order, if one
+   was published since the last call, else NULL.  It stays valid until
+   the next call. */
+const vector3 *ps_snapshots_read (PSSnapshots *snap, gint *num_nodes);
+
+/* Optional knobs for the render functions; pass NULL for the defaults. */
+typedef struct _PSRenderOptions
+{
+    /* If set, the output is handed out in blocks as it is rendered instead of
+       being stored in samples (which may be NULL then).  Streamed blocks are
+       not normalized: scale them by 1.0 / peak afterwards. */
+    PSBlockCallback	*sink;
+    gpointer		sink_data;
+    /* If set, samples are left unnormalized as well, for a caller which
+       applies 1.0 / peak in its own pass over them */
+    gboolean		raw;
+
+    /* Filled in by the renderer: peak absolute value of the raw output */
+    gdouble		peak;
+
+    /* PS_STEP_SUBSTEP by default; substepping sounds the same as the
+       speed asked for would if it were stable, only slower to render */
+    PSStepMode		step;
+    /* PS_METAL_OBJ_EULER by default.  PS_METAL_OBJ_IMPLICIT never needs to
+       substep, so step is ignored for it. */
+    PSMetalObjIntegrator integrator;
+
+    /* If set, kept up to date while rendering */
+    PSRenderProgress	*progress;
+
+    /* If set, the object's positions are published every
+       snapshot_interval samples */
+    PSSnapshots		*snapshots;
+    gint		snapshot_interval;
+    /* Steps per sample: at least this many (0 is 1), and filled in with
+       the count used.  Also filled in: the largest stable speed. */
+    gint		substeps;
+    gdouble		max_speed;
+    /* The physics may run at rate / divisor, upsampled to rate, which
+       saves that share of the work.  At most this divisor (0 is 1) is
+       used, and only as far as the object's highest mode stays far below
+       the lower rate, so its pitch is kept; filled in with the divisor
+       used.  Never done for PS_METAL_OBJ_IMPLICIT. */
+    gint		divisor;
+    /* Filled in: why the render ended, and the node updates it took,
+       i.e. the awake nodes summed over every step */
+    PSRenderStop	stop;
+    gint64		node_steps;
+} PSRenderOptions;
+
+/* The render functions return the number of samples rendered, or
+   PS_RENDER_UNSTABLE if the simulation diverged (speed too high for the
+   object); samples, and anything handed to a sink, are garbage then. */
+#define PS_RENDER_UNSTABLE -1
+
+gint ps_metal_obj_render_tube (gint rate, gint height, gint circum, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att, gpointer userdata, PSRenderOptions *opts);
+gint ps_metal_obj_render_rod (gint rate, gint length, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att,  gpointer userdata, PSRenderOptions *opts);
+gint ps_metal_obj_render_plane (gint rate, gint length, gint width, gdouble tension, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att,  gpointer userdata, PSRenderOptions *opts);
+
+/* An object built once and struck any number of times, for instance at
+   several velocities.  Rendering doesn't change it, so one topology can be
+   shared by several threads.  The constructors return NULL on failure. */
+typedef struct _PSMetalTopology PSMetalTopology;
+
+PSMetalTopology *ps_metal_topology_new_tube (gint height, gint circum, gdouble tension);
+PSMetalTopology *ps_metal_topology_new_rod (gint length, gdouble tension);
+PSMetalTopology *ps_metal_topology_new_plane (gint length, gint width, gdouble tension);
+void ps_metal_topology_free (PSMetalTopology *topo);
+/* Largest speed the object can be simulated at in one step per sample,
+   estimated from its stiffness when it is built */
+gdouble ps_metal_topology_max_speed (const PSMetalTopology *topo);
+gint ps_metal_topology_render (const PSMetalTopology *topo, gint rate, gdouble speed, gdouble damp, gint compress, gdouble velocity, gint len, gdouble *samples, PSPercentCallback *cb, gdouble att, gpointer userdata, PSRenderOptions *opts);
+
+/* While the springs stay in their linear range, the raw (unnormalized)
+   render of an object is affine in the strike velocity: renders a and b
+   at velocities va and vb predict the one at any v in between.  The
+   prediction is stored in out, n samples long. */
+void ps_render_interpolate (const gdouble *a, gint na, gdouble va, const gdouble *b, gint nb, gdouble vb, gdouble v, gdouble *out, gint n);
 
 #ifdef __cplusplus
 }
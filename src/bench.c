@@ -0,0 +1,166 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Integrator benchmark.  Quality is measured on the sound, not on the
+   node positions: the fingerprint of every render is compared to one of
+   the same strike simulated with much smaller steps, so a shifted or
+   damped partial counts as much as it would be heard. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "bench.h"
+#include "fingerprint.h"
+#include "main.h"
+
+#define BENCH_RATE 44100
+#define BENCH_SECONDS 1.0
+/* Reference steps, relative to what the Euler run needs */
+#define BENCH_REFERENCE_SUBSTEPS 16
+
+static const gchar *integrator_names[BENCH_INTEGRATORS] = {
+    "euler", "verlet", "implicit"
+};
+
+const gchar*
+bench_integrator_name (PSMetalObjIntegrator integrator)
+{
+    return integrator_names[integrator];
+}
+
+static gint
+bench_render (const PSMetalTopology *topo, const PsiPreset *preset,
+	      PSRenderOptions *opts, gint len, gdouble *samples,
+	      gdouble *seconds)
+{
+    GTimer	*timer;
+    gint	n;
+
+    timer = g_timer_new();
+    n = ps_metal_topology_render(topo, BENCH_RATE, preset->speed,
+				 preset->damping, preset->actuation,
+				 preset->velocity, len, samples, NULL, 0.0,
+				 NULL, opts);
+    *seconds = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    return n;
+}
+
+gboolean
+bench_integrators (const PsiPreset *preset, gdouble seconds,
+		   PsiBenchResult *results)
+{
+    PSMetalTopology	*topo;
+    PSRenderOptions	opts = { NULL };
+    PsiFingerprint	reference, fp;
+    PsiBenchResult	*r;
+    gdouble		*samples, elapsed;
+    gint		len, n, i;
+
+    topo = preset_topology(preset);
+    if (topo == NULL)
+	return FALSE;
+
+    len = (gint) (BENCH_RATE * seconds);
+    samples = g_new(gdouble, MAX(len, 1));
+
+    /* A one sample render tells the steps Euler takes on its own */
+    bench_render(topo, preset, &opts, 1, samples, &elapsed);
+    opts.substeps *= BENCH_REFERENCE_SUBSTEPS;
+    n = bench_render(topo, preset, &opts, len, samples, &elapsed);
+    if (n == PS_RENDER_UNSTABLE) {
+	g_free(samples);
+	ps_metal_topology_free(topo);
+	return FALSE;
+    }
+    fingerprint_compute(&reference, samples, n, BENCH_RATE);
+
+    for (i = 0; i < BENCH_INTEGRATORS; i++) {
+	r = &results[i];
+	memset(&opts, 0, sizeof(opts));
+	opts.integrator = i;
+
+	r->integrator = i;
+	r->samples = bench_render(topo, preset, &opts, len, samples, &r->seconds);
+	r->substeps = opts.substeps;
+	r->steps_per_second = r->samples > 0 && r->seconds > 0.0 ?
+	    (gdouble) r->samples * r->substeps / r->seconds : 0.0;
+	r->error = G_MAXDOUBLE;
+	if (r->samples != PS_RENDER_UNSTABLE) {
+	    fingerprint_compute(&fp, samples, r->samples, BENCH_RATE);
+	    r->error = fingerprint_distance(&fp, &reference);
+	}
+    }
+
+    g_free(samples);
+    ps_metal_topology_free(topo);
+
+    return TRUE;
+}
+
+int
+bench_main (int argc, char *argv[])
+{
+    PsiPreset		preset;
+    PsiBenchResult	results[BENCH_INTEGRATORS];
+    gdouble		seconds = BENCH_SECONDS;
+    gint		i;
+
+    if (argc < 2 || argc > 3) {
+	fprintf(stderr, _("Usage: %s --integrators INSTRUMENT [SECONDS]\n"),
+		PACKAGE);
+	return 2;
+    }
+
+    if (argc > 2 && (seconds = atof(argv[2])) <= 0.0) {
+	fprintf(stderr, _("%s is not a length in seconds\n"), argv[2]);
+	return 2;
+    }
+
+    if (!preset_load(&preset, argv[1])) {
+	fprintf(stderr, _("%s is not an instrument\n"), argv[1]);
+	return 1;
+    }
+
+    if (!bench_integrators(&preset, seconds, results)) {
+	fprintf(stderr, _("Could not render a reference for %s\n"), argv[1]);
+	return 1;
+    }
+
+    printf("%-10s %8s %12s %8s\n", "integrator", "substeps", "steps/s", "error");
+    for (i = 0; i < BENCH_INTEGRATORS; i++) {
+	if (results[i].samples == PS_RENDER_UNSTABLE)
+	    printf("%-10s %8d %12s %8s\n", bench_integrator_name(i),
+		   results[i].substeps, "-", _("unstable"));
+	else
+	    printf("%-10s %8d %12.0f %8.4f\n", bench_integrator_name(i),
+		   results[i].substeps, results[i].steps_per_second,
+		   results[i].error);
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PSI_BENCH
+#define _PSI_BENCH
+
+#include <glib.h>
+
+#include "api-wrapper.h"
+#include "preset.h"
+
+#define BENCH_INTEGRATORS (PS_METAL_OBJ_IMPLICIT + 1)
+
+/* One integrator's run, see bench_integrators() */
+typedef struct _PsiBenchResult
+{
+    PSMetalObjIntegrator	integrator;
+    gint			substeps;	/* per sample */
+    gint			samples;	/* PS_RENDER_UNSTABLE if it blew up */
+    gdouble			seconds;	/* to render them */
+    gdouble			steps_per_second;
+    gdouble			error;		/* fingerprint_distance() */
+} PsiBenchResult;
+
+const gchar*	bench_integrator_name	(PSMetalObjIntegrator integrator);
+
+/* Strikes preset with every integrator for up to seconds of sound, at the
+   steps per sample each needs to stay stable, and compares the spectra to
+   a reference rendered with BENCH_REFERENCE_SUBSTEPS times as many Euler
+   steps.  Fills in results[BENCH_INTEGRATORS]; returns FALSE if the
+   preset couldn't be built or the reference blew up. */
+gboolean	bench_integrators	(const PsiPreset *preset, gdouble seconds,
+					 PsiBenchResult *results);
+
+/* psindustrializer --integrators INSTRUMENT [SECONDS]: prints the
+   comparison.  Returns the exit status. */
+int		bench_main		(int argc, char *argv[]);
+
+#endif
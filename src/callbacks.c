@@ -37,17 +37,22 @@
 #include <string.h>
 #include <stdlib.h>
 #include <gtk/gtk.h>
-#include <audiofile.h>
 
 #include "callbacks.h"
 #include "interface.h"
 #include "api-wrapper.h"
+#include "convert.h"
 #include "main.h"
-#include "xml-parser.h"
+#include "player.h"
+#include "export.h"
+#include "preset.h"
+#include "telemetry.h"
+#include "trace.h"
 
 GtkWidget *status_label, *progressbar1;
 
-static const int rate = 44100;
+/* Rate of the current take, conf_rate when it was rendered */
+static int rate = 44100;
 
 static int size;
 static int height = 10, circum = 5, length = 5;
@@ -56,7 +61,11 @@ static double tenseness = 4.0, speed = 0.2, damping = 0.05;
 static int actuation = 0;
 static double velocity = 1.0;
 static double sample_length = 1.0;
-gint16 *samples = NULL;
+/* The raw take, and the gain which normalizes it.  It is kept as floats
+   and only converted on its way to the player or a file. */
+static gfloat *take = NULL;
+static gint take_written;
+static double take_gain = 1.0;
 static PSMetalObj *object = NULL;
 static GMutex render_mutex;
 static GtkWidget *area = NULL;
@@ -65,20 +74,37 @@ static float x_angle = 90.0, y_angle = 0.0;
 static gboolean decay_is_used = FALSE;
 static double decay_value = 0.0;
 
-static gfloat percent = 0.0;
+/* Updated by the render thread, polled by render_done */
+static PSRenderProgress progress;
 
 typedef void (*CallbackFunc)(gpointer data);
 static gboolean need_render = TRUE;
 static CallbackFunc render_done_callback = NULL;
 static CallbackFunc render_done_userdata = NULL;
 
-static const gchar *types[] = {"tube", "rod", "plane"};
-#define OBJ_NUM 3 /* Last object index */
+/* Set while a render streams straight into a file instead of take */
+static PsiExport *export = NULL;
+static gboolean export_ok;
+
+/* How the last render had to step, from its PSRenderOptions */
+static int substeps;
+static double max_speed;
+/* What it cost */
+static PsiRenderStats render_stats;
+
+/* Positions published by the running render, for the GL view, at this
+   many snapshots per second of sound */
+static PSSnapshots *snapshots = NULL;
+#define VIBRATION_SNAPSHOTS 200
 
 static void save_wav_callback(GtkWidget * widget, gpointer user_data);
+static void current_preset(PsiPreset * preset);
 
 #ifdef HAVE_OPENGL
 static void glarea_update(GtkWidget * widget);
+static void glarea_set_object(const PSMetalObj * obj);
+static void vibration_start(void);
+static void vibration_stop(void);
 #endif
 
 static
@@ -100,29 +126,13 @@ gchar* filename_correct_ext(const gchar* fname, const gchar* ext)
     return name_ret;
 }
 
-static int double_to_s16(double d)
-{
-    int out;
-
-    if (d >= 1.0)
-	out = 32767;
-    else if (d <= -1.0)
-	out = -32768;
-    else
-	out = (int) ((d + 1.0) * 32768.0 - 32768.0);
-
-    return out;
-}
-
-
-static void percent_callback(gfloat p, gpointer userdata)
-{
-    percent = p;
-}
 
+/* Rebuilds the object once the pending slider ticks are handled */
+static guint render_object_idle = 0;
 
-static void render_object()
+static gboolean render_object_now(gpointer data)
 {
+    render_object_idle = 0;
     ps_metal_obj_free(object);
 
     switch (obj_type) {
@@ -141,8 +151,17 @@ static void render_object()
     }
 
 #ifdef HAVE_OPENGL
+    glarea_set_object(object);
     gtk_widget_queue_draw(area);
 #endif    
+
+    return FALSE;
+}
+
+static void render_object()
+{
+    if (render_object_idle == 0)
+	render_object_idle = g_idle_add(render_object_now, NULL);
 }
 
 static void instrument_changed()
@@ -150,6 +169,11 @@ static void instrument_changed()
     need_render = TRUE;
 }
 
+void render_settings_changed(void)
+{
+    instrument_changed();
+}
+
 gboolean
 on_AppWindow_delete_event(GtkWidget *widget,
 			  GdkEvent *event, gpointer user_data)
@@ -253,70 +277,171 @@ static void set_percent(gfloat percent)
     gtk_progress_set_percentage(GTK_PROGRESS(progressbar1), percent);
 }
 
+/* PSBlockCallback storing the raw take */
+static void take_write(const gdouble *block, gint n, gpointer userdata)
+{
+    convert_samples(block, n, 1.0, CONVERT_FLOAT, take + take_written, NULL);
+    take_written += n;
+}
+
 static void *do_render(void *appwin)
 {
-    int i;
     gfloat decay;
+    PSRenderOptions opts = { NULL };
+    GTimer *timer;
+    gdouble cpu;
+    gint64 start, span;
 
-    static double *data;
     static unsigned int alloc_length = 0;
 
+    trace_thread_name("render");
+    start = trace_begin();
+
     size = (int) (rate * sample_length);
-    if (size > alloc_length) {
-	data = g_renew(double, data, size);
-	samples = g_renew(gint16, samples, size);
-	alloc_length = size;
+    opts.progress = &progress;
+    opts.snapshots = snapshots;
+    opts.snapshot_interval = rate / VIBRATION_SNAPSHOTS;
+    opts.divisor = conf_reduced_rate ? PS_RATE_DIVISOR_MAX : 0;
+    /* Either way the renderer only needs a block of doubles */
+    if (export) {
+	opts.sink = export_write;
+	opts.sink_data = export;
+    } else {
+	if (size > alloc_length) {
+	    take = g_renew(gfloat, take, size);
+	    alloc_length = size;
+	}
+	take_written = 0;
+	opts.sink = take_write;
     }
 
     decay = decay_is_used ? decay_value : 0;
 
+    timer = g_timer_new();
+    cpu = telemetry_cpu_time();
+
     switch (obj_type) {
     case 0:
 	size =
 	    ps_metal_obj_render_tube(rate, height, circum, tenseness,
 				     speed, damping, actuation, velocity,
-				     size, data, percent_callback, decay,
-				     NULL);
+				     size, NULL, NULL, decay, NULL, &opts);
 	break;
 
     case 1:
 	size =
 	    ps_metal_obj_render_rod(rate, length, tenseness, speed,
 				    damping, actuation, velocity, size,
-				    data, percent_callback, decay, NULL);
+				    NULL, NULL, decay, NULL, &opts);
 	break;
 
     case 2:
 	size =
 	    ps_metal_obj_render_plane(rate, plane_length, plane_width,
 				      tenseness, speed, damping, actuation,
-				      velocity, size, data,
-				      percent_callback, decay, NULL);
+				      velocity, size, NULL, NULL, decay,
+				      NULL, &opts);
 	break;
     }
 
-    for (i = 0; i < size; i++)
-	samples[i] = double_to_s16(data[i]);
+    render_stats.wall = g_timer_elapsed(timer, NULL);
+    render_stats.cpu = telemetry_cpu_time() - cpu;
+    g_timer_destroy(timer);
+    render_stats.rate = rate;
+    render_stats.samples = size;
+    render_stats.substeps = opts.substeps;
+    render_stats.node_steps = opts.node_steps;
+    render_stats.peak_rss = telemetry_peak_rss();
+    render_stats.stop = opts.stop;
+
+    substeps = opts.substeps;
+    max_speed = opts.max_speed;
+
+    if (export) {
+	span = trace_begin();
+	if (size == PS_RENDER_UNSTABLE)
+	    export_cancel(export);
+	else
+	    export_ok = export_finish(export, opts.peak);
+	trace_end("export finish", span);
+    } else
+	take_gain = 1.0 / opts.peak;
+    trace_end("render", start);
 
     g_mutex_unlock(&render_mutex);
 
     return NULL;
 }
 
+/* Appends the last render to renders.csv in the configuration directory */
+static void log_render(void)
+{
+    PsiPreset preset;
+    gchar *fname;
+
+    current_preset(&preset);
+    fname = g_build_filename(g_get_home_dir(), "."PACKAGE, "renders.csv", NULL);
+    if (!telemetry_log(fname, &preset, &render_stats))
+	g_warning("Could not append to %s", fname);
+    g_free(fname);
+}
+
 static gint render_done(void *widget)
 {
+    gchar *msg, *stats;
+
     if (g_mutex_trylock(&render_mutex)) {
 	gui_set_sensitive(TRUE);
-	set_status_message(_("Done..."));
+#ifdef HAVE_OPENGL
+	vibration_stop();
+#endif
+	if (conf_render_log)
+	    log_render();
+	if (size == PS_RENDER_UNSTABLE) {
+	    /* Nothing usable came out, neither in take nor in the file */
+	    set_status_message(export ? _("Not saved") : _("Unstable"));
+	    export = NULL;
+	    need_render = TRUE;
+	    size = 0;
+	    gui_set_size_label(0.0);
+	    set_percent(0.0);
+	    g_mutex_unlock(&render_mutex);
+	    gui_error_msg(_("The simulation became unstable.  Lower the speed "
+			    "or the tension and render again."));
+	    return FALSE;
+	}
+	if (export) {
+	    /* The take went to the file only, there is nothing to play */
+	    export = NULL;
+	    need_render = TRUE;
+	    if (export_ok)
+		set_status_message(_("Saved..."));
+	    else {
+		set_status_message(_("Not saved"));
+		gui_error_msg(_("Could not write file."));
+	    }
+	} else {
+	    stats = telemetry_describe(&render_stats);
+	    /* Speed is past the stable limit; that costs render time */
+	    if (substeps > 1)
+		msg = g_strdup_printf(_("Done: %s, %d steps per sample above speed %.3f"),
+				      stats, substeps, max_speed);
+	    else
+		msg = g_strdup_printf(_("Done: %s"), stats);
+	    set_status_message(msg);
+	    g_free(msg);
+	    g_free(stats);
+	}
 	gui_set_size_label((gfloat) size / rate);
-	percent = 0.0;
-	set_percent(percent);
+	set_percent(0.0);
 	g_mutex_unlock(&render_mutex);
         if (render_done_callback)
             render_done_callback(render_done_userdata);
 	return FALSE;
     } else {
-	set_percent(percent);
+	set_percent(ps_render_progress_fraction(&progress,
+						(gint) (rate * sample_length),
+						decay_is_used ? decay_value : 0));
     }
 
     return TRUE;
@@ -330,11 +455,16 @@ void start_render(CallbackFunc callback, gpointer userdata)
 	return;
 
     gui_set_sensitive(FALSE);
-    set_status_message(_("Rendering..."));
-    percent = 0.0;
+    set_status_message(export ? _("Rendering to file...") : _("Rendering..."));
+    g_atomic_int_set(&progress.samples, 0);
+    g_atomic_int_set(&progress.decay, 0);
     need_render = FALSE;
+    rate = conf_rate;
     render_done_callback = callback;
     render_done_userdata = userdata;
+#ifdef HAVE_OPENGL
+    vibration_start();
+#endif
 
     if (pthread_create(&thread, NULL, do_render, NULL) != 0)
 	do_render(NULL);
@@ -347,7 +477,7 @@ void trigger_play(gpointer user_data)
     if (!g_mutex_trylock(&render_mutex))
         return;
 
-    if (samples != NULL && driver != NULL) {
+    if (take != NULL) {
 #ifdef WIN32
         HWAVEOUT out;
         WAVEFORMATEX format;
@@ -355,7 +485,7 @@ void trigger_play(gpointer user_data)
 
         format.wFormatTag = WAVE_FORMAT_PCM;
         format.nChannels = 1;
-        format.nSamplesPerSec = 44100;
+        format.nSamplesPerSec = rate;
         format.nBlockAlign = 2;
         format.nAvgBytesPerSec =
             format.nSamplesPerSec * format.nBlockAlign;
@@ -371,7 +501,8 @@ void trigger_play(gpointer user_data)
             GlobalAllocPtr(GMEM_MOVEABLE | GMEM_SHARE, size * 2);
         hdr->dwBufferLength = size * 2;
         hdr->dwFlags = 0;
-        memcpy(hdr->lpData, samples, size * 2);
+        convert_float_samples(take, size, take_gain, CONVERT_S16,
+                              hdr->lpData, NULL);
         waveOutPrepareHeader(out, hdr, sizeof(WAVEHDR));
         waveOutWrite(out, hdr, sizeof(WAVEHDR));
         while (!(hdr->dwFlags & WHDR_DONE)) {
@@ -384,26 +515,10 @@ void trigger_play(gpointer user_data)
         waveOutClose(out);
 
 #else
-        int n, nbytes;
-        gint16 *ptr;
-
-        ptr = samples;
-        nbytes = size;
-        while (nbytes > 0) {
-            if (nbytes > 2048)
-                n = 2048;
-            else
-                n = nbytes;
-            n = driver->play(ptr, n);
-            if (n < 0) {
-                psi_driver_errmessage(n);
-                break;
-            }
-            if (n > 0) {
-                ptr += n;
-                nbytes -= n;
-            }
-        }
+        gint64 start = trace_begin();
+
+        player_play(take, size, take_gain, conf_dither, conf_play_overlap);
+        trace_end("play", start);
 #endif
 
     }
@@ -426,28 +541,31 @@ void on_space_pressed(gpointer user_data)
         trigger_play(NULL);
 }
 
+void on_escape_pressed(gpointer user_data)
+{
+    player_stop();
+}
+
 void trigger_save(gpointer user_data)
 {
     static GtkWidget *fileselector = NULL;
-    if(samples != NULL) {
-	if(!fileselector)
-	    fileselector = gui_create_FileSelector(save_wav_callback,_("Save .WAV file"),
-						   conf_sample_path);
-	else {
-	    gtk_widget_show(fileselector);
-	    gtk_widget_grab_focus(fileselector);
-	}
 
+    if(!fileselector)
+	fileselector = gui_create_FileSelector(save_wav_callback,_("Save sound file"),
+					       conf_sample_path);
+    else {
 	gtk_widget_show(fileselector);
+	gtk_widget_grab_focus(fileselector);
     }
+
+    gtk_widget_show(fileselector);
 }
 
+/* An outdated take is not rendered into memory first: save_wav_do()
+   streams a fresh render straight into the chosen file instead. */
 void on_save_clicked(GtkButton * button, gpointer user_data)
 {
-    if (need_render)
-        start_render(trigger_save, NULL);
-    else
-        trigger_save(NULL);
+    trigger_save(NULL);
 }
 
 
@@ -474,7 +592,26 @@ void save_wav_do(GtkWidget * widget, gint response, gchar *fname)
     g_free(path1);
     g_free(path);
 
-    if (samples != NULL) {
+#ifndef WIN32
+    if (need_render) {
+	/* Renders are only started from this thread, so this can't race */
+	if (!g_mutex_trylock(&render_mutex))
+	    return;
+	g_mutex_unlock(&render_mutex);
+
+	if ((export = export_open(fname, conf_rate, conf_export_format, conf_dither)) != NULL)
+	    start_render(NULL, NULL);
+	else {
+	    g_print("Could not write file %s\n", fname);
+	    gui_error_msg(_("Could not write file."));
+	}
+	if(conf_autoext)
+	    g_free(fname);
+	return;
+    }
+#endif
+
+    if (take != NULL) {
 #ifdef WIN32
 	/* Microsoft is such a b*stard... they couldn't have made this
 	   operation more opaque. */
@@ -485,10 +622,13 @@ void save_wav_do(GtkWidget * widget, gint response, gchar *fname)
 	PCMWAVEFORMAT format;
 	gint32 total = size * 2;
 	gint32 i;
+	gint16 *samples = g_new(gint16, MAX(size, 1));
+
+	convert_float_samples(take, size, take_gain, CONVERT_S16, samples, NULL);
 
 	format.wf.wFormatTag = WAVE_FORMAT_PCM;
 	format.wf.nChannels = 1;
-	format.wf.nSamplesPerSec = 44100;
+	format.wf.nSamplesPerSec = rate;
 	format.wf.nBlockAlign = 2;
 	format.wf.nAvgBytesPerSec =
 	    format.wf.nSamplesPerSec * format.wf.nBlockAlign;
@@ -529,29 +669,18 @@ void save_wav_do(GtkWidget * widget, gint response, gchar *fname)
 	mmioAscend(wav, &out, 0);
 	mmioAscend(wav, &outRiff, 0);
 	mmioClose(wav, 0);
+	g_free(samples);
 #else
-	AFfilehandle wav;
-	AFfilesetup setup;
-
-	setup = afNewFileSetup();
-	afInitFileFormat(setup, AF_FILE_WAVE);
-	afInitSampleFormat(setup, AF_DEFAULT_TRACK, AF_SAMPFMT_TWOSCOMP,
-			   16);
-	afInitByteOrder(setup, AF_DEFAULT_TRACK,
-			AF_BYTEORDER_LITTLEENDIAN);
-	afInitChannels(setup, AF_DEFAULT_TRACK, 1);
-	afInitRate(setup, AF_DEFAULT_TRACK, 44100.0);
-
-	wav = afOpenFile(fname, "w", setup);
-	if (wav != NULL) {
-	    afWriteFrames(wav, AF_DEFAULT_TRACK, samples, size);
-	    afCloseFile(wav);
-	} else {
+	gint64 start = trace_begin();
+	gboolean ok;
+
+	ok = export_save_float(fname, rate, conf_export_format, take, size,
+			       take_gain, conf_dither);
+	trace_end("export", start);
+	if (!ok) {
 	    g_print("Could not write file %s\n", fname);
 	    gui_error_msg(_("Could not write file."));
 	}
-
-	afFreeFileSetup(setup);
 #endif
 	if(conf_autoext)
 	    g_free(fname);
@@ -569,7 +698,7 @@ save_wav_callback (GtkWidget * widget, gpointer user_data)
     /* Hack, but rather harmless... I don't want to add variables without need. */
     fname = (gchar*)gtk_file_selection_get_filename(GTK_FILE_SELECTION(widget));
     if(conf_autoext)
-	fname = filename_correct_ext(fname, "wav");
+	fname = filename_correct_ext(fname, export_format_extension(conf_export_format));
     if(conf_overwrite_warning && g_file_test(fname, G_FILE_TEST_EXISTS))
 	overwrite_dialog = gui_ok_cancel_dialog(overwrite_dialog, _("File overwrite warning"),
 				_("Warning! File exists!\nWould you like to overwrite it?"),
@@ -602,75 +731,153 @@ static gint glarea_release(GtkWidget * widget, GdkEventMotion * event)
     return TRUE;
 }
 
+/* The nodes are drawn as cubes from one vertex array, free nodes first
+   and anchors after them, so a redraw takes a single draw call per
+   material.  The array and the view are only set up when the object is
+   rebuilt. */
+#define CUBE_VERTICES 24
+
+/* Frames per second shown while rendering */
+#define VIBRATION_FPS 60
+/* Largest displacement shown, relative to the view, and how fast the
+   scale follows a quieter object, per frame */
+#define VIBRATION_SCALE 0.1
+#define VIBRATION_DECAY 0.97
+
+static GLfloat *node_vertices = NULL, *node_normals = NULL;
+static gint node_free = 0, node_anchors = 0;
+static float view_center[3], view_size = 1.0;
+
+/* Corners of each face as a triangle strip, with its normal */
+static const struct {
+    GLfloat normal[3];
+    guchar corner[4][3];
+} cube_faces[6] = {
+    { {  0.0,  0.0, -1.0 }, { {0, 0, 0}, {0, 1, 0}, {1, 0, 0}, {1, 1, 0} } },
+    { {  1.0,  0.0,  0.0 }, { {1, 0, 0}, {1, 1, 0}, {1, 0, 1}, {1, 1, 1} } },
+    { {  0.0,  0.0,  1.0 }, { {1, 0, 1}, {1, 1, 1}, {0, 0, 1}, {0, 1, 1} } },
+    { { -1.0,  0.0,  0.0 }, { {0, 0, 1}, {0, 1, 1}, {0, 0, 0}, {0, 1, 0} } },
+    { {  0.0, -1.0,  0.0 }, { {0, 0, 1}, {0, 0, 0}, {1, 0, 1}, {1, 0, 0} } },
+    { {  0.0,  1.0,  0.0 }, { {0, 1, 0}, {0, 1, 1}, {1, 1, 0}, {1, 1, 1} } }
+};
+
+/* Stores a cube of half size ptsize around pos as CUBE_VERTICES quad
+   vertices */
 static void
-cube(float x1, float x2, float y1, float y2, float z1, float z2)
+cube(GLfloat * v, GLfloat * n, const vector3 * pos, float ptsize)
 {
-    /* Face 1 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(0.0, 0.0, -1.0);
-    glVertex3f(x1, y1, z1);
-    glVertex3f(x1, y2, z1);
-    glVertex3f(x2, y1, z1);
-    glVertex3f(x2, y2, z1);
-    glEnd();
-
-    /* Face 2 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(1.0, 0.0, 0.0);
-    glVertex3f(x2, y1, z1);
-    glVertex3f(x2, y2, z1);
-    glVertex3f(x2, y1, z2);
-    glVertex3f(x2, y2, z2);
-    glEnd();
-
-    /* Face 3 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(0.0, 0.0, 1.0);
-    glVertex3f(x2, y1, z2);
-    glVertex3f(x2, y2, z2);
-    glVertex3f(x1, y1, z2);
-    glVertex3f(x1, y2, z2);
-    glEnd();
-
-    /* Face 4 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(-1.0, 0.0, 0.0);
-    glVertex3f(x1, y1, z2);
-    glVertex3f(x1, y2, z2);
-    glVertex3f(x1, y1, z1);
-    glVertex3f(x1, y2, z1);
-    glEnd();
-
-    /* Face 5 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(0.0, -1.0, 0.0);
-    glVertex3f(x1, y1, z2);
-    glVertex3f(x1, y1, z1);
-    glVertex3f(x2, y1, z2);
-    glVertex3f(x2, y1, z1);
-    glEnd();
-
-    /* Face 6 */
-    glBegin(GL_TRIANGLE_STRIP);
-    glNormal3f(0.0, 1.0, 0.0);
-    glVertex3f(x1, y2, z1);
-    glVertex3f(x1, y2, z2);
-    glVertex3f(x2, y2, z1);
-    glVertex3f(x2, y2, z2);
-    glEnd();
+    /* A strip's 0 1 2 3 is the quad 0 1 3 2 */
+    static const gint order[4] = { 0, 1, 3, 2 };
+    const guchar *c;
+    gint f, i;
+
+    for (f = 0; f < 6; f++)
+	for (i = 0; i < 4; i++) {
+	    c = cube_faces[f].corner[order[i]];
+	    *v++ = pos->x + (c[0] ? ptsize : -ptsize);
+	    *v++ = pos->y + (c[1] ? ptsize : -ptsize);
+	    *v++ = pos->z + (c[2] ? ptsize : -ptsize);
+	    *n++ = cube_faces[f].normal[0];
+	    *n++ = cube_faces[f].normal[1];
+	    *n++ = cube_faces[f].normal[2];
+	}
 }
 
-static void glarea_update(GtkWidget * widget)
+/* Fills the vertex array with obj's nodes, moved from where they are in
+   obj by gain times their displacement in pos, if pos is set */
+static void
+glarea_set_nodes(const PSMetalObj * obj, const vector3 * pos, gint n,
+		 float gain)
+{
+    int i, anchor;
+    vector3 v3;
+    float ptsize;
+    gint k;
+
+    ptsize = tenseness * 0.4;
+    if (ptsize > 0.4)
+	ptsize = 0.4;
+
+    node_vertices = g_renew(GLfloat, node_vertices,
+			    obj->num_nodes * CUBE_VERTICES * 3);
+    node_normals = g_renew(GLfloat, node_normals,
+			   obj->num_nodes * CUBE_VERTICES * 3);
+
+    k = 0;
+    for (anchor = FALSE; anchor <= TRUE; anchor++)
+	for (i = 0; i < obj->num_nodes; i++)
+	    if (!obj->nodes[i]->anchor == !anchor) {
+		v3 = obj->nodes[i]->pos;
+		if (pos != NULL && i < n) {
+		    v3.x += (pos[i].x - v3.x) * gain;
+		    v3.y += (pos[i].y - v3.y) * gain;
+		    v3.z += (pos[i].z - v3.z) * gain;
+		}
+		cube(node_vertices + k, node_normals + k, &v3, ptsize);
+		k += CUBE_VERTICES * 3;
+	    }
+}
+
+/* Sets up the view for obj at rest; it isn't moved to follow vibrations */
+static void glarea_set_object(const PSMetalObj * obj)
 {
     int i;
-    vector3 *v3;
+    const vector3 *v3;
     float maxx, maxy, maxz;
     float minx, miny, minz;
     float max, min;
-    float cenx, ceny, cenz;
-    float size;
-    float ptsize;
 
+    node_free = node_anchors = 0;
+    if (obj == NULL)
+	return;
+
+    minx = maxx = 0.0;
+    miny = maxy = 0.0;
+    minz = maxz = 0.0;
+
+    for (i = 0; i < obj->num_nodes; i++) {
+	v3 = &obj->nodes[i]->pos;
+
+	if (v3->x < minx)
+	    minx = v3->x;
+	if (v3->y < miny)
+	    miny = v3->y;
+	if (v3->z < minz)
+	    minz = v3->z;
+	if (v3->x > maxx)
+	    maxx = v3->x;
+	if (v3->y > maxy)
+	    maxy = v3->y;
+	if (v3->z > maxz)
+	    maxz = v3->z;
+
+	if (obj->nodes[i]->anchor)
+	    node_anchors++;
+	else
+	    node_free++;
+    }
+
+    min = minx;
+    if (miny < min)
+	min = miny;
+    if (minz < min)
+	min = minz;
+    max = maxx;
+    if (maxy > max)
+	max = maxy;
+    if (maxz > max)
+	max = maxz;
+
+    view_center[0] = (minx + maxx) / 2.0;
+    view_center[1] = (miny + maxy) / 2.0;
+    view_center[2] = (minz + maxz) / 2.0;
+    view_size = (max - min) / 2.0 * 1.2;
+
+    glarea_set_nodes(obj, NULL, 0, 1.0);
+}
+
+static void glarea_update(GtkWidget * widget)
+{
     GLfloat light_ambient[] = { 0.5, 0.5, 0.5, 1.0 };
     GLfloat light_diffuse[] = { 1.0, 1.0, 1.0, 1.0 };
     GLfloat light_specular[] = { 1.0, 1.0, 1.0, 1.0 };
@@ -688,44 +895,7 @@ static void glarea_update(GtkWidget * widget)
     if (gdk_gl_drawable_gl_begin (gldrawable, glcontext)) {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	if (object != NULL) {
-	    minx = maxx = 0.0;
-	    miny = maxy = 0.0;
-	    minz = maxz = 0.0;
-
-	    for (i = 0; i < object->num_nodes; i++) {
-		v3 = &object->nodes[i]->pos;
-
-		if (v3->x < minx)
-		    minx = v3->x;
-		if (v3->y < miny)
-		    miny = v3->y;
-		if (v3->z < minz)
-		    minz = v3->z;
-		if (v3->x > maxx)
-		    maxx = v3->x;
-		if (v3->y > maxy)
-		    maxy = v3->y;
-		if (v3->z > maxz)
-		    maxz = v3->z;
-	    }
-
-	    min = minx;
-	    if (miny < min)
-		min = miny;
-	    if (minz < min)
-		min = minz;
-	    max = maxx;
-	    if (maxy > max)
-		max = maxy;
-	    if (maxz > max)
-		max = maxz;
-
-	    cenx = (minx + maxx) / 2.0;
-	    ceny = (miny + maxy) / 2.0;
-	    cenz = (minz + maxz) / 2.0;
-	    size = (max - min) / 2.0 * 1.2;
-
+	if (node_free + node_anchors > 0) {
 	    glEnable(GL_LIGHTING);
 	    glEnable(GL_LIGHT0);
 	    glDepthRange(0.4, 0.6);
@@ -740,7 +910,7 @@ static void glarea_update(GtkWidget * widget)
 	    glMatrixMode(GL_PROJECTION);
 	    glLoadIdentity();
 	    glFrustum(-1.0, 1.0, -1.0, 1.0, 1.0, 200.0);
-	    glScalef(95.0 / size, 95.0 / size, 1.0);
+	    glScalef(95.0 / view_size, 95.0 / view_size, 1.0);
 
 	    glMatrixMode(GL_MODELVIEW);
 	    glLoadIdentity();
@@ -755,23 +925,21 @@ static void glarea_update(GtkWidget * widget)
 	    glTranslatef(0.0, 0.0, -100.0);
 	    glRotatef(y_angle, 1.0, 0.0, 0.0);
 	    glRotatef(x_angle, 0.0, 1.0, 0.0);
-	    glTranslatef(-cenx, -ceny, -cenz);
-
-	    ptsize = tenseness * 0.4;
-	    if (ptsize > 0.4)
-		ptsize = 0.4;
+	    glTranslatef(-view_center[0], -view_center[1], -view_center[2]);
 
-	    for (i = 0; i < object->num_nodes; i++) {
-		v3 = &object->nodes[i]->pos;
+	    glEnableClientState(GL_VERTEX_ARRAY);
+	    glEnableClientState(GL_NORMAL_ARRAY);
+	    glVertexPointer(3, GL_FLOAT, 0, node_vertices);
+	    glNormalPointer(GL_FLOAT, 0, node_normals);
 
-		if (object->nodes[i]->anchor)
-		    glMaterialfv(GL_FRONT, GL_DIFFUSE, red_mat_diffuse);
-		else
-		    glMaterialfv(GL_FRONT, GL_DIFFUSE, white_mat_diffuse);
+	    glMaterialfv(GL_FRONT, GL_DIFFUSE, white_mat_diffuse);
+	    glDrawArrays(GL_QUADS, 0, node_free * CUBE_VERTICES);
+	    glMaterialfv(GL_FRONT, GL_DIFFUSE, red_mat_diffuse);
+	    glDrawArrays(GL_QUADS, node_free * CUBE_VERTICES,
+			 node_anchors * CUBE_VERTICES);
 
-		cube(v3->x - ptsize, v3->x + ptsize, v3->y - ptsize,
-		     v3->y + ptsize, v3->z - ptsize, v3->z + ptsize);
-	    }
+	    glDisableClientState(GL_NORMAL_ARRAY);
+	    glDisableClientState(GL_VERTEX_ARRAY);
 	}
 
         if (gdk_gl_drawable_is_double_buffered (gldrawable))
@@ -782,6 +950,67 @@ static void glarea_update(GtkWidget * widget)
     }
 }
 
+/* While rendering, the view follows the struck object.  Its motion is
+   scaled up to VIBRATION_SCALE of the view, against a peak which decays
+   slowly, so both the strike and the quiet ringing after it show. */
+static float vibration_peak;
+static guint vibration_timeout = 0;
+
+static gboolean vibration_update(gpointer data)
+{
+    const vector3 *pos;
+    vector3 *rest;
+    float d, peak = 0.0;
+    gint n, i;
+
+    if ((pos = ps_snapshots_read(snapshots, &n)) == NULL || object == NULL)
+	return TRUE;
+
+    n = MIN(n, object->num_nodes);
+    for (i = 0; i < n; i++) {
+	rest = &object->nodes[i]->pos;
+	d = fabs(pos[i].x - rest->x) + fabs(pos[i].y - rest->y) +
+	    fabs(pos[i].z - rest->z);
+	peak = MAX(peak, d);
+    }
+    vibration_peak = MAX(vibration_peak * VIBRATION_DECAY, peak);
+
+    glarea_set_nodes(object, pos, n, vibration_peak > 0.0 ?
+		     MAX(1.0, VIBRATION_SCALE * view_size / vibration_peak) : 1.0);
+    gtk_widget_queue_draw(area);
+
+    return TRUE;
+}
+
+static void vibration_start(void)
+{
+    /* The view must show the object which is about to be rendered */
+    if (render_object_idle != 0) {
+	g_source_remove(render_object_idle);
+	render_object_now(NULL);
+    }
+
+    if (area == NULL || !GTK_WIDGET_REALIZED(area) || object == NULL)
+	return;
+
+    snapshots = ps_snapshots_new(object->num_nodes);
+    vibration_peak = 0.0;
+    vibration_timeout = g_timeout_add(1000 / VIBRATION_FPS, vibration_update, NULL);
+}
+
+/* Only once the render thread is done */
+static void vibration_stop(void)
+{
+    if (snapshots == NULL)
+	return;
+
+    g_source_remove(vibration_timeout);
+    ps_snapshots_free(snapshots);
+    snapshots = NULL;
+    glarea_set_object(object);
+    gtk_widget_queue_draw(area);
+}
+
 static gint glarea_motion(GtkWidget * widget, GdkEventMotion * event)
 {
     /* This code is borrowed from the planetmm GtkGLArea-- sample app. */
@@ -920,7 +1149,7 @@ GtkWidget *tension_hscale_create (gchar * widget_name, gchar * string1,
 
     adj =
 	GTK_ADJUSTMENT(gtk_adjustment_new
-		       (4.0, 0.1, 16.0, 0.005, 0.1, 0.0));
+		       (4.0, PRESET_TENSION_MIN, PRESET_TENSION_MAX, 0.005, 0.1, 0.0));
 
     hscale = GTK_HSCALE(gtk_hscale_new(adj));
 
@@ -961,10 +1190,77 @@ on_error_ok_button_clicked (GtkWidget * widget, gpointer user_data)
     gtk_widget_destroy(widget);
 }
 
+/* The raw take and the gain which normalizes it, or NULL while it is
+   outdated or being rendered */
+const gfloat*
+current_take (gint *n, gint *take_rate, gdouble *gain)
+{
+    if (need_render || take == NULL || !g_mutex_trylock(&render_mutex))
+	return NULL;
+    g_mutex_unlock(&render_mutex);
+
+    *n = size;
+    *take_rate = rate;
+    *gain = take_gain;
+    return take;
+}
+
+static void
+current_preset (PsiPreset *preset)
+{
+    preset_init(preset);
+    preset->type = obj_type;
+    preset->height = height;
+    preset->circum = circum;
+    preset->length = length;
+    preset->plane_length = plane_length;
+    preset->plane_width = plane_width;
+    preset->tension = tenseness;
+    preset->speed = speed;
+    preset->damping = damping;
+    preset->actuation = actuation;
+    preset->velocity = velocity;
+}
+
+void
+apply_preset (const PsiPreset *preset)
+{
+    obj_type = preset->type;
+    gui_set_topology(obj_type);
+
+    switch(obj_type) {
+    case PRESET_TUBE:
+	height = preset->height;
+	circum = preset->circum;
+	gui_configure_tube(height, circum);
+	break;
+    case PRESET_ROD:
+	length = preset->length;
+	gui_configure_rod(length);
+	break;
+    case PRESET_PLANE:
+	plane_length = preset->plane_length;
+	plane_width = preset->plane_width;
+	gui_configure_plane(plane_length, plane_width);
+	break;
+    default:
+	break;
+    }
+
+    tenseness = preset->tension;
+    speed = preset->speed;
+    damping = preset->damping;
+    actuation = preset->actuation;
+    velocity = preset->velocity;
+    gui_set_values(tenseness, speed, damping, actuation, velocity);
+
+    instrument_changed();
+}
+
 static void
 save_ins_do (GtkWidget *widget, gint response, gchar* fname)
 {
-    xmlpContext	*instr;
+    PsiPreset	preset;
     gchar	*path, *path1;
 
     if(widget)
@@ -980,34 +1276,8 @@ save_ins_do (GtkWidget *widget, gint response, gchar* fname)
     g_free(path1);
     g_free(path);
 
-    instr = xmlp_new_doc(fname, "psiinstr");
-    
-    xmlp_set_string(instr, "", "type", types[obj_type]);
-
-    switch(obj_type) {
-    case 0: /* tube */
-	xmlp_set_int(instr, "", "height", height);
-	xmlp_set_int(instr, "", "circumference", circum);
-	break;
-    case 1: /* rod */
-	xmlp_set_int(instr, "", "length", length);
-	break;
-    case 2: /* plane */
-	xmlp_set_int(instr, "", "length", plane_length);
-	xmlp_set_int(instr, "", "width", plane_width);
-	break;
-    default:
-	break;
-    }
-    
-    xmlp_set_double(instr, "", "tension", tenseness);
-    xmlp_set_double(instr, "", "speed", speed);
-    xmlp_set_double(instr, "", "damping", damping);
-    xmlp_set_int(instr, "", "actuation", actuation);
-    xmlp_set_double(instr, "", "velocity", velocity);
-    
-    xmlp_sync(instr);
-    xmlp_free(instr);
+    current_preset(&preset);
+    preset_save(&preset, fname);
     if(conf_autoext)
 	g_free(fname);
     
@@ -1052,9 +1322,8 @@ static
 void load_ins_callback (GtkWidget * widget, gpointer user_data)
 {
     G_CONST_RETURN gchar *fname;
-    xmlpContext *instr;
-    gchar *type, *path, *path1;
-    guint i, itype = 0;
+    PsiPreset preset;
+    gchar *path, *path1;
 
     fname = gtk_file_selection_get_filename(GTK_FILE_SELECTION(widget));
     path = g_path_get_dirname(fname);
@@ -1065,48 +1334,11 @@ void load_ins_callback (GtkWidget * widget, gpointer user_data)
     g_free(path1);
     g_free(path);
 
-    instr = xmlp_get_doc(fname, "psiinstr");
-    if(!instr)
+    if(!preset_load(&preset, fname))
 	return;
-    
-    type = xmlp_get_string_default(instr, "", "type", "tube");
-    for(i = 0; i < OBJ_NUM; i++) {
-	if(!g_ascii_strcasecmp(type, types[i]))
-	    itype = i;
-    }
-    obj_type = itype;
-    gui_set_topology(itype);
-    
-    switch(itype) {
-    case 0: /* tube */
-	height = xmlp_get_int_default(instr, "", "height", 10);
-	circum = xmlp_get_int_default(instr, "", "circumference", 5);
-	gui_configure_tube(height, circum);
-	break;
-    case 1: /* rod */
-	length = xmlp_get_int_default(instr, "", "length", 5);
-	gui_configure_rod(length);
-	break;
-    case 2: /* plane */
-	plane_length = xmlp_get_int_default(instr, "", "length", 7);
-	plane_width = xmlp_get_int_default(instr, "", "width", 9);
-	gui_configure_plane(plane_length, plane_width);
-	break;
-    default:
-	break;
-    }
-    
-    tenseness = xmlp_get_double_default(instr, "", "tension", 4.0);
-    speed = xmlp_get_double_default(instr, "", "speed", 0.2);
-    damping = xmlp_get_double_default(instr, "", "damping", 0.05);
-    actuation = xmlp_get_int_default(instr, "", "actuation", 0);
-    velocity = xmlp_get_double_default(instr, "", "velocity", 1.0);
-    gui_set_values(tenseness, speed, damping, actuation, velocity);
-    xmlp_sync(instr);
-    xmlp_free(instr);
+    apply_preset(&preset);
     
     gtk_widget_hide(widget);
-    instrument_changed();
 }
 
 void
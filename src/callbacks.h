@@ -21,6 +21,8 @@
 
 #include <gtk/gtk.h>
 
+#include "preset.h"
+
 gboolean
 on_AppWindow_delete_event              (GtkWidget       *widget,
                                         GdkEvent        *event,
@@ -132,4 +134,15 @@ load_ins_clicked		       (GtkWidget       *widget,
                                         gpointer         user_data);
 void
 on_space_pressed		       (gpointer         user_data);
+void
+on_escape_pressed		       (gpointer         user_data);
+void
+apply_preset			       (const PsiPreset *preset);
+/* The sample rate or the reduced rate setting changed */
+void
+render_settings_changed		       (void);
+const gfloat*
+current_take			       (gint            *n,
+					gint            *take_rate,
+					gdouble         *gain);
 #endif
@@ -0,0 +1,191 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Final conversion of a take: the normalizing gain, clipping, dither and
+   quantization are done in a single pass from the raw samples into the
+   playback or file format.  With SSE2 four samples are converted at a
+   time; the dithered path stays scalar, as its noise is a serial
+   sequence. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <math.h>
+#include <glib.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "convert.h"
+
+/* Floats are widened this many at a time, into a buffer that stays in
+   the cache */
+#define CONVERT_CHUNK 1024
+
+void
+convert_dither_init (PsiDither *dither)
+{
+    dither->state = 2463534242u;
+}
+
+gint
+convert_sample_size (PsiSampleFormat format)
+{
+    return format == CONVERT_S16 ? sizeof(gint16) :
+	   format == CONVERT_S24 ? sizeof(gint32) : sizeof(gfloat);
+}
+
+/* Uniform in [0, 1), xorshift32 */
+static inline gdouble
+convert_random (PsiDither *dither)
+{
+    guint32 x = dither->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dither->state = x;
+
+    return (x >> 8) * (1.0 / 16777216.0);
+}
+
+/* Same arithmetic as the vector loop below, for the samples it leaves */
+static inline gint32
+convert_truncate (gdouble d, gdouble scale)
+{
+    d = (d + 1.0) * scale - scale;
+
+    return (gint32) CLAMP(d, -scale, scale - 1.0);
+}
+
+static void
+convert_int (const gdouble *in, gint n, gdouble gain, gdouble scale,
+	     gint16 *out16, gint32 *out32, PsiDither *dither)
+{
+    gint	i = 0;
+    gdouble	d;
+    gint32	v;
+
+    if (dither) {
+	for (i = 0; i < n; i++) {
+	    d = in[i] * gain * scale +
+		convert_random(dither) - convert_random(dither);
+	    d = floor(d + 0.5);
+	    v = (gint32) CLAMP(d, -scale, scale - 1.0);
+	    if (out16)
+		out16[i] = v;
+	    else
+		out32[i] = v;
+	}
+	return;
+    }
+
+#ifdef __SSE2__
+    {
+	const __m128d	g = _mm_set1_pd(gain), one = _mm_set1_pd(1.0);
+	const __m128d	s = _mm_set1_pd(scale);
+	const __m128d	lo = _mm_set1_pd(-scale), hi = _mm_set1_pd(scale - 1.0);
+	__m128d		a, b;
+	__m128i		v4;
+
+	for (; i + 4 <= n; i += 4) {
+	    a = _mm_mul_pd(_mm_loadu_pd(in + i), g);
+	    b = _mm_mul_pd(_mm_loadu_pd(in + i + 2), g);
+	    a = _mm_sub_pd(_mm_mul_pd(_mm_add_pd(a, one), s), s);
+	    b = _mm_sub_pd(_mm_mul_pd(_mm_add_pd(b, one), s), s);
+	    a = _mm_min_pd(_mm_max_pd(a, lo), hi);
+	    b = _mm_min_pd(_mm_max_pd(b, lo), hi);
+	    v4 = _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b));
+	    if (out16)
+		_mm_storel_epi64((__m128i *) (out16 + i), _mm_packs_epi32(v4, v4));
+	    else
+		_mm_storeu_si128((__m128i *) (out32 + i), v4);
+	}
+    }
+#endif
+
+    for (; i < n; i++) {
+	v = convert_truncate(in[i] * gain, scale);
+	if (out16)
+	    out16[i] = v;
+	else
+	    out32[i] = v;
+    }
+}
+
+static void
+convert_float (const gdouble *in, gint n, gdouble gain, gfloat *out)
+{
+    gint	i = 0;
+
+#ifdef __SSE2__
+    {
+	const __m128d	g = _mm_set1_pd(gain);
+	__m128		a, b;
+
+	for (; i + 4 <= n; i += 4) {
+	    a = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(in + i), g));
+	    b = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(in + i + 2), g));
+	    _mm_storeu_ps(out + i, _mm_movelh_ps(a, b));
+	}
+    }
+#endif
+
+    for (; i < n; i++)
+	out[i] = in[i] * gain;
+}
+
+void
+convert_samples (const gdouble *in, gint n, gdouble gain,
+		 PsiSampleFormat format, gpointer out, PsiDither *dither)
+{
+    switch (format) {
+    case CONVERT_S16:
+	convert_int(in, n, gain, 32768.0, out, NULL, dither);
+	break;
+    case CONVERT_S24:
+	convert_int(in, n, gain, 8388608.0, NULL, out, dither);
+	break;
+    case CONVERT_FLOAT:
+	convert_float(in, n, gain, out);
+	break;
+    }
+}
+
+void
+convert_float_samples (const gfloat *in, gint n, gdouble gain,
+		       PsiSampleFormat format, gpointer out, PsiDither *dither)
+{
+    gdouble	wide[CONVERT_CHUNK];
+    gint	len, i;
+
+    while (n > 0) {
+	len = MIN(n, CONVERT_CHUNK);
+	for (i = 0; i < len; i++)
+	    wide[i] = in[i];
+
+	convert_samples(wide, len, gain, format, out, dither);
+
+	out = (guint8 *) out + len * convert_sample_size(format);
+	in += len;
+	n -= len;
+    }
+}
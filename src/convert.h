@@ -0,0 +1,57 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_CONVERT
+#define _PSI_CONVERT
+
+#include <glib.h>
+
+/* Destination formats of convert_samples().  24-bit samples are kept in
+   the low bits of a gint32, as audiofile expects them. */
+typedef enum {
+    CONVERT_S16,
+    CONVERT_S24,
+    CONVERT_FLOAT
+} PsiSampleFormat;
+
+/* State of the dither noise, so a take converted in blocks gets one
+   uninterrupted noise sequence */
+typedef struct _PsiDither
+{
+    guint32	state;
+} PsiDither;
+
+void		convert_dither_init	(PsiDither *dither);
+
+/* Bytes per converted sample */
+gint		convert_sample_size	(PsiSampleFormat format);
+
+/* Scales n raw samples by gain and stores them in out, in one pass.
+   Integer formats are clipped to full scale.  Without dither they are
+   truncated exactly as playback always has; with it, triangular noise of
+   one step peak is added before rounding.  Floats are never dithered. */
+void		convert_samples		(const gdouble *in, gint n, gdouble gain,
+					 PsiSampleFormat format, gpointer out,
+					 PsiDither *dither);
+/* The same from a take kept as floats */
+void		convert_float_samples	(const gfloat *in, gint n, gdouble gain,
+					 PsiSampleFormat format, gpointer out,
+					 PsiDither *dither);
+
+#endif
@@ -0,0 +1,377 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Sample file export.  Every format is converted from the raw doubles by
+   convert_samples(), which applies the normalizing gain in the same pass;
+   audiofile only packs the result. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <audiofile.h>
+
+#include "export.h"
+#include "convert.h"
+#include "trace.h"
+#include "api-wrapper.h"
+#include "main.h"
+
+typedef struct _ExportFormatInfo
+{
+    const gchar	*name;
+    const gchar	*description;
+    const gchar	*extension;
+    gint	file_format;
+    gint	sample_format;
+    gint	sample_width;
+    gint	compression;
+    PsiSampleFormat	convert;
+} ExportFormatInfo;
+
+/* Entries left empty are not supported by this build */
+static const ExportFormatInfo formats[EXPORT_FORMATS] = {
+    { "wav16", N_("WAV, 16-bit"), "wav",
+      AF_FILE_WAVE, AF_SAMPFMT_TWOSCOMP, 16, AF_COMPRESSION_NONE,
+      CONVERT_S16 },
+    { "wav24", N_("WAV, 24-bit"), "wav",
+      AF_FILE_WAVE, AF_SAMPFMT_TWOSCOMP, 24, AF_COMPRESSION_NONE,
+      CONVERT_S24 },
+    { "float", N_("WAV, 32-bit float"), "wav",
+      AF_FILE_WAVE, AF_SAMPFMT_FLOAT, 32, AF_COMPRESSION_NONE,
+      CONVERT_FLOAT },
+#ifdef HAVE_AF_FLAC
+    { "flac", N_("FLAC, 24-bit"), "flac",
+      AF_FILE_FLAC, AF_SAMPFMT_TWOSCOMP, 24, AF_COMPRESSION_FLAC,
+      CONVERT_S24 },
+#endif
+};
+
+typedef struct _ExportBlock
+{
+    gint	n;
+    gdouble	data[1];
+} ExportBlock;
+
+struct _PsiExport
+{
+    AFfilehandle	wav;
+    PsiExportFormat	format;
+    PsiDither		dither;
+    gboolean		dithered;
+    FILE		*spool;	/* raw unnormalized take, unlinked on open */
+    GAsyncQueue		*queue;	/* ExportBlocks for the encoder thread */
+    GThread		*thread;
+    gchar		*fname;
+    gdouble		peak;	/* set before export_end is queued */
+    gboolean		cancelled;	/* likewise */
+    gboolean		failed;	/* only touched by the encoder thread */
+};
+
+/* Queued after the last block of a take */
+static ExportBlock export_end;
+
+gboolean
+export_format_available (PsiExportFormat format)
+{
+    return format < EXPORT_FORMATS && formats[format].name != NULL;
+}
+
+const gchar*
+export_format_name (PsiExportFormat format)
+{
+    return formats[format].name;
+}
+
+const gchar*
+export_format_description (PsiExportFormat format)
+{
+    return _(formats[format].description);
+}
+
+const gchar*
+export_format_extension (PsiExportFormat format)
+{
+    return formats[format].extension;
+}
+
+PsiExportFormat
+export_format_lookup (const gchar *name)
+{
+    PsiExportFormat format;
+
+    if (name == NULL)
+	return EXPORT_WAV_16;
+
+    for (format = 0; format < EXPORT_FORMATS; format++)
+	if (export_format_available(format) &&
+	    !g_ascii_strcasecmp(formats[format].name, name))
+	    return format;
+
+    return EXPORT_WAV_16;
+}
+
+static AFfilehandle
+export_create (const gchar *fname, gint rate, PsiExportFormat format)
+{
+    const ExportFormatInfo *info = &formats[format];
+    AFfilehandle	wav;
+    AFfilesetup		setup;
+
+    if (!export_format_available(format))
+	return AF_NULL_FILEHANDLE;
+
+    setup = afNewFileSetup();
+    afInitFileFormat(setup, info->file_format);
+    afInitSampleFormat(setup, AF_DEFAULT_TRACK, info->sample_format,
+		       info->sample_width);
+    afInitCompression(setup, AF_DEFAULT_TRACK, info->compression);
+    afInitByteOrder(setup, AF_DEFAULT_TRACK, AF_BYTEORDER_LITTLEENDIAN);
+    afInitChannels(setup, AF_DEFAULT_TRACK, 1);
+    afInitRate(setup, AF_DEFAULT_TRACK, (double) rate);
+
+    wav = afOpenFile(fname, "w", setup);
+    afFreeFileSetup(setup);
+
+    return wav;
+}
+
+static gboolean
+export_encode (AFfilehandle wav, PsiExportFormat format,
+	       const gdouble *in, gint n, gdouble gain, PsiDither *dither)
+{
+    gint32	out[PS_RENDER_BLOCK];	/* big enough for any format */
+    gint	len;
+
+    while (n > 0) {
+	len = MIN(n, PS_RENDER_BLOCK);
+
+	convert_samples(in, len, gain, formats[format].convert, out, dither);
+	if (afWriteFrames(wav, AF_DEFAULT_TRACK, out, len) != len)
+	    return FALSE;
+
+	in += len;
+	n -= len;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+export_encode_float (AFfilehandle wav, PsiExportFormat format,
+		     const gfloat *in, gint n, gdouble gain, PsiDither *dither)
+{
+    gint32	out[PS_RENDER_BLOCK];
+    gint	len;
+
+    while (n > 0) {
+	len = MIN(n, PS_RENDER_BLOCK);
+
+	convert_float_samples(in, len, gain, formats[format].convert, out, dither);
+	if (afWriteFrames(wav, AF_DEFAULT_TRACK, out, len) != len)
+	    return FALSE;
+
+	in += len;
+	n -= len;
+    }
+
+    return TRUE;
+}
+
+/* Second pass: normalize the spooled take into the destination.
+   audiofile fills in the header sizes when the file is closed. */
+static void
+export_encode_spool (PsiExport *export)
+{
+    gdouble	block[PS_RENDER_BLOCK];
+    gdouble	gain;
+    size_t	n;
+
+    gain = 1.0 / export->peak;
+    if (fflush(export->spool) != 0 || fseek(export->spool, 0, SEEK_SET) != 0)
+	export->failed = TRUE;
+
+    while (!export->failed &&
+	   (n = fread(block, sizeof(gdouble), PS_RENDER_BLOCK, export->spool)) > 0)
+	if (!export_encode(export->wav, export->format, block, n, gain,
+			   export->dithered ? &export->dither : NULL))
+	    export->failed = TRUE;
+
+    if (ferror(export->spool))
+	export->failed = TRUE;
+}
+
+static gpointer
+export_thread (gpointer data)
+{
+    PsiExport	*export = data;
+    ExportBlock	*block;
+    gint64	start;
+
+    trace_thread_name("export");
+
+    while ((block = g_async_queue_pop(export->queue)) != &export_end) {
+	start = trace_begin();
+	if (!export->failed &&
+	    fwrite(block->data, sizeof(gdouble), block->n, export->spool) != (size_t) block->n)
+	    export->failed = TRUE;
+	g_free(block);
+	trace_end("spool", start);
+    }
+
+    if (!export->cancelled) {
+	start = trace_begin();
+	export_encode_spool(export);
+	trace_end("encode", start);
+    }
+
+    return NULL;
+}
+
+PsiExport*
+export_open (const gchar *fname, gint rate, PsiExportFormat format,
+	     gboolean dither)
+{
+    PsiExport	*export;
+    gchar	*spool_name;
+
+    export = g_new0(PsiExport, 1);
+    export->format = format;
+    export->dithered = dither;
+    convert_dither_init(&export->dither);
+
+    /* Spool next to the destination rather than in a tmpfs /tmp */
+    spool_name = g_strconcat(fname, ".part", NULL);
+    export->spool = fopen(spool_name, "w+b");
+    if (export->spool)
+	unlink(spool_name);
+    g_free(spool_name);
+
+    if (export->spool == NULL) {
+	g_free(export);
+	return NULL;
+    }
+
+    export->wav = export_create(fname, rate, format);
+    if (export->wav == AF_NULL_FILEHANDLE) {
+	fclose(export->spool);
+	g_free(export);
+	return NULL;
+    }
+
+    export->fname = g_strdup(fname);
+    export->queue = g_async_queue_new();
+    export->thread = g_thread_new("export", export_thread, export);
+
+    return export;
+}
+
+void
+export_write (const gdouble *block, gint n, gpointer data)
+{
+    PsiExport	*export = data;
+    ExportBlock	*copy;
+
+    copy = g_malloc(sizeof(ExportBlock) + sizeof(gdouble) * (n - 1));
+    copy->n = n;
+    memcpy(copy->data, block, sizeof(gdouble) * n);
+    g_async_queue_push(export->queue, copy);
+}
+
+static gboolean
+export_close (PsiExport *export)
+{
+    gboolean	ok;
+
+    g_async_queue_push(export->queue, &export_end);
+    g_thread_join(export->thread);
+    g_async_queue_unref(export->queue);
+
+    if (afCloseFile(export->wav) != 0)
+	export->failed = TRUE;
+    fclose(export->spool);
+
+    if (export->cancelled)
+	unlink(export->fname);
+
+    ok = !export->failed;
+    g_free(export->fname);
+    g_free(export);
+
+    return ok;
+}
+
+gboolean
+export_finish (PsiExport *export, gdouble peak)
+{
+    export->peak = peak;
+
+    return export_close(export);
+}
+
+void
+export_cancel (PsiExport *export)
+{
+    export->cancelled = TRUE;
+    export_close(export);
+}
+
+gboolean
+export_save (const gchar *fname, gint rate, PsiExportFormat format,
+	     const gdouble *data, gint n, gdouble gain, gboolean dither)
+{
+    AFfilehandle	wav;
+    PsiDither		state;
+    gboolean		ok;
+
+    wav = export_create(fname, rate, format);
+    if (wav == AF_NULL_FILEHANDLE)
+	return FALSE;
+
+    convert_dither_init(&state);
+    ok = export_encode(wav, format, data, n, gain, dither ? &state : NULL);
+    if (afCloseFile(wav) != 0)
+	ok = FALSE;
+
+    return ok;
+}
+
+gboolean
+export_save_float (const gchar *fname, gint rate, PsiExportFormat format,
+		   const gfloat *data, gint n, gdouble gain, gboolean dither)
+{
+    AFfilehandle	wav;
+    PsiDither		state;
+    gboolean		ok;
+
+    wav = export_create(fname, rate, format);
+    if (wav == AF_NULL_FILEHANDLE)
+	return FALSE;
+
+    convert_dither_init(&state);
+    ok = export_encode_float(wav, format, data, n, gain, dither ? &state : NULL);
+    if (afCloseFile(wav) != 0)
+	ok = FALSE;
+
+    return ok;
+}
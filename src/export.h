@@ -0,0 +1,68 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_EXPORT
+#define _PSI_EXPORT
+
+#include <glib.h>
+
+typedef struct _PsiExport PsiExport;
+
+/* Formats which can't be written by this build come last, so the
+   available ones are always 0 .. n-1 */
+typedef enum {
+    EXPORT_WAV_16,
+    EXPORT_WAV_24,
+    EXPORT_WAV_FLOAT,
+    EXPORT_FLAC,
+    EXPORT_FORMATS
+} PsiExportFormat;
+
+gboolean	export_format_available		(PsiExportFormat format);
+/* Short name kept in the configuration file */
+const gchar*	export_format_name		(PsiExportFormat format);
+const gchar*	export_format_description	(PsiExportFormat format);
+const gchar*	export_format_extension		(PsiExportFormat format);
+/* Falls back to 16-bit WAV for unknown or unavailable formats */
+PsiExportFormat	export_format_lookup		(const gchar *name);
+
+/* Streaming export: open the destination, feed export_write() from the
+   renderer (it is a PSBlockCallback) and call export_finish() with the peak
+   value once rendering is done.  The raw take is spooled next to the
+   destination by an encoder thread, which also does the final normalizing
+   pass, so the renderer never waits for the disk and only a few blocks
+   are held in memory.  Integer formats get TPDF dither if dither is set. */
+PsiExport*	export_open	(const gchar *fname, gint rate, PsiExportFormat format,
+				 gboolean dither);
+void		export_write	(const gdouble *block, gint n, gpointer export);
+gboolean	export_finish	(PsiExport *export, gdouble peak);
+/* Throws the take away, e.g. when the render failed, and removes the
+   destination again */
+void		export_cancel	(PsiExport *export);
+
+/* Writes a take in one go, scaled by gain */
+gboolean	export_save	(const gchar *fname, gint rate, PsiExportFormat format,
+				 const gdouble *data, gint n, gdouble gain,
+				 gboolean dither);
+/* Likewise for a take kept as floats */
+gboolean	export_save_float (const gchar *fname, gint rate, PsiExportFormat format,
+				   const gfloat *data, gint n, gdouble gain,
+				   gboolean dither);
+
+#endif
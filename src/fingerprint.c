@@ -0,0 +1,291 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Spectral fingerprints.  The sound is cut into Hann windowed frames
+   which go through a radix-2 FFT; the strongest partials of the first
+   frames (the strike) are the modal peaks, and each of them is followed
+   through the later frames to estimate how fast it rings out. */
+
+#include <math.h>
+#include <glib.h>
+
+#include "fingerprint.h"
+
+#define FP_FFT_BITS 11
+#define FP_FFT_SIZE (1 << FP_FFT_BITS)	/* 46 ms at 44.1 kHz */
+#define FP_HOP (FP_FFT_SIZE / 2)
+#define FP_BINS (FP_FFT_SIZE / 2)
+/* Frames summed for peak picking */
+#define FP_ATTACK_FRAMES 8
+/* Peaks closer than this many bins are one partial */
+#define FP_PEAK_SPACING 3
+/* Weaker peaks are noise, not modes */
+#define FP_PEAK_FLOOR_DB -60.0
+/* Decay is measured over the first 30 dB and extrapolated */
+#define FP_DECAY_DB 30.0
+#define FP_MAX_DECAY 60.0
+/* Cost of a partial with nothing to match it against */
+#define FP_NO_MATCH 4.0
+
+typedef struct _FftTables
+{
+    gdouble	cos_t[FP_FFT_SIZE / 2];
+    gdouble	sin_t[FP_FFT_SIZE / 2];
+    gdouble	window[FP_FFT_SIZE];
+} FftTables;
+
+static void
+fft_tables_init (FftTables *t)
+{
+    gint i;
+
+    for (i = 0; i < FP_FFT_SIZE / 2; i++) {
+	t->cos_t[i] = cos(2.0 * G_PI * i / FP_FFT_SIZE);
+	t->sin_t[i] = sin(2.0 * G_PI * i / FP_FFT_SIZE);
+    }
+    for (i = 0; i < FP_FFT_SIZE; i++)
+	t->window[i] = 0.5 - 0.5 * cos(2.0 * G_PI * i / FP_FFT_SIZE);
+}
+
+/* In-place iterative radix-2 FFT of FP_FFT_SIZE points */
+static void
+fft (const FftTables *t, gdouble *re, gdouble *im)
+{
+    gint i, j, k, bit, len, half, step, a, b;
+    gdouble wr, wi, tr, ti;
+
+    for (i = 1, j = 0; i < FP_FFT_SIZE; i++) {
+	for (bit = FP_FFT_SIZE >> 1; j & bit; bit >>= 1)
+	    j ^= bit;
+	j ^= bit;
+	if (i < j) {
+	    tr = re[i];
+	    re[i] = re[j];
+	    re[j] = tr;
+	    ti = im[i];
+	    im[i] = im[j];
+	    im[j] = ti;
+	}
+    }
+
+    for (len = 2; len <= FP_FFT_SIZE; len <<= 1) {
+	half = len >> 1;
+	step = FP_FFT_SIZE / len;
+	for (i = 0; i < FP_FFT_SIZE; i += len)
+	    for (k = 0; k < half; k++) {
+		wr = t->cos_t[k * step];
+		wi = -t->sin_t[k * step];
+		a = i + k;
+		b = a + half;
+		tr = re[b] * wr - im[b] * wi;
+		ti = re[b] * wi + im[b] * wr;
+		re[b] = re[a] - tr;
+		im[b] = im[a] - ti;
+		re[a] += tr;
+		im[a] += ti;
+	    }
+    }
+}
+
+/* Seconds to fall by 60 dB, from the first FP_DECAY_DB after the maximum */
+static gdouble
+decay_time (const gdouble *env, gint frames, gdouble dt)
+{
+    gdouble	limit, drop;
+    gint	f, fmax = 0;
+
+    for (f = 1; f < frames; f++)
+	if (env[f] > env[fmax])
+	    fmax = f;
+    if (env[fmax] <= 0.0 || fmax == frames - 1)
+	return dt;
+
+    limit = env[fmax] * pow(10.0, -FP_DECAY_DB / 10.0);
+    for (f = fmax + 1; f < frames - 1; f++)
+	if (env[f] < limit)
+	    break;
+
+    drop = 10.0 * log10(env[fmax] / MAX(env[f], 1e-30));
+    if (drop < 0.1)
+	return FP_MAX_DECAY;
+
+    return CLAMP(60.0 * (f - fmax) * dt / drop, dt, FP_MAX_DECAY);
+}
+
+void
+fingerprint_compute (PsiFingerprint *fp, const gdouble *samples, gint n, gint rate)
+{
+    FftTables	*t;
+    gdouble	re[FP_FFT_SIZE], im[FP_FFT_SIZE];
+    gdouble	attack[FP_BINS], total[FP_BINS];
+    gdouble	*env, sum, moment, a, b, c, p, tmp;
+    gfloat	*spec, swap;
+    gint	peaks[FP_PEAKS];
+    gint	frames, npeaks = 0, f, i, j, k, best;
+
+    t = g_new(FftTables, 1);
+    fft_tables_init(t);
+
+    frames = n > FP_FFT_SIZE ? (n - FP_FFT_SIZE) / FP_HOP + 1 : 1;
+    spec = g_new(gfloat, (gsize) frames * FP_BINS);
+    env = g_new(gdouble, frames);
+
+    for (k = 0; k < FP_BINS; k++)
+	attack[k] = total[k] = 0.0;
+
+    for (f = 0; f < frames; f++) {
+	for (i = 0; i < FP_FFT_SIZE; i++) {
+	    j = f * FP_HOP + i;
+	    re[i] = j < n ? samples[j] * t->window[i] : 0.0;
+	    im[i] = 0.0;
+	}
+	fft(t, re, im);
+
+	for (k = 0; k < FP_BINS; k++) {
+	    p = re[k] * re[k] + im[k] * im[k];
+	    spec[f * FP_BINS + k] = p;
+	    total[k] += p;
+	    if (f < FP_ATTACK_FRAMES)
+		attack[k] += p;
+	}
+    }
+
+    /* Spectral centroid of the whole sound, DC left out */
+    sum = moment = 0.0;
+    for (k = 1; k < FP_BINS; k++) {
+	sum += total[k];
+	moment += total[k] * k;
+    }
+    fp->centroid = sum > 0.0 ? moment / sum * rate / FP_FFT_SIZE : 0.0;
+
+    /* Strongest well separated local maxima of the strike */
+    while (npeaks < FP_PEAKS) {
+	best = -1;
+	for (k = 1; k < FP_BINS - 1; k++) {
+	    if (attack[k] <= attack[k - 1] || attack[k] < attack[k + 1])
+		continue;
+	    if (best >= 0 && attack[k] <= attack[best])
+		continue;
+	    for (i = 0; i < npeaks; i++)
+		if (ABS(k - peaks[i]) < FP_PEAK_SPACING)
+		    break;
+	    if (i == npeaks)
+		best = k;
+	}
+	if (best < 0 || (npeaks > 0 &&
+			 10.0 * log10(attack[best] / attack[peaks[0]]) < FP_PEAK_FLOOR_DB))
+	    break;
+	peaks[npeaks++] = best;
+    }
+
+    for (i = 0; i < FP_PEAKS; i++) {
+	fp->freq[i] = fp->level[i] = fp->decay[i] = 0.0;
+	if (i >= npeaks)
+	    continue;
+
+	/* Parabolic interpolation of the peak on a dB scale */
+	k = peaks[i];
+	a = 10.0 * log10(MAX(attack[k - 1], 1e-30));
+	b = 10.0 * log10(MAX(attack[k], 1e-30));
+	c = 10.0 * log10(MAX(attack[k + 1], 1e-30));
+	tmp = a - 2.0 * b + c;
+	p = tmp < 0.0 ? 0.5 * (a - c) / tmp : 0.0;
+	fp->freq[i] = (k + p) * rate / FP_FFT_SIZE;
+	fp->level[i] = 10.0 * log10(attack[k] / attack[peaks[0]]);
+
+	for (f = 0; f < frames; f++)
+	    env[f] = spec[f * FP_BINS + k - 1] + spec[f * FP_BINS + k] +
+		spec[f * FP_BINS + k + 1];
+	fp->decay[i] = decay_time(env, frames, (gdouble) FP_HOP / rate);
+    }
+
+    for (f = 0; f < frames; f++) {
+	env[f] = 0.0;
+	for (k = 1; k < FP_BINS; k++)
+	    env[f] += spec[f * FP_BINS + k];
+    }
+    fp->decay_all = decay_time(env, frames, (gdouble) FP_HOP / rate);
+
+    /* Ascending frequency, unused slots last */
+    for (i = 1; i < npeaks; i++)
+	for (j = i; j > 0 && fp->freq[j] < fp->freq[j - 1]; j--) {
+	    swap = fp->freq[j];
+	    fp->freq[j] = fp->freq[j - 1];
+	    fp->freq[j - 1] = swap;
+	    swap = fp->level[j];
+	    fp->level[j] = fp->level[j - 1];
+	    fp->level[j - 1] = swap;
+	    swap = fp->decay[j];
+	    fp->decay[j] = fp->decay[j - 1];
+	    fp->decay[j - 1] = swap;
+	}
+
+    g_free(env);
+    g_free(spec);
+    g_free(t);
+}
+
+static gdouble
+log2_ratio (gdouble a, gdouble b)
+{
+    return fabs(log(MAX(a, 1e-3) / MAX(b, 1e-3))) / G_LN2;
+}
+
+/* Mean mismatch of a's partials against their nearest partner in b,
+   weighted by amplitude */
+static gdouble
+peaks_cost (const PsiFingerprint *a, const PsiFingerprint *b)
+{
+    gdouble	cost = 0.0, weight = 0.0, w, d, best;
+    gint	i, j, partner;
+
+    for (i = 0; i < FP_PEAKS; i++) {
+	if (a->freq[i] <= 0.0)
+	    continue;
+
+	partner = -1;
+	best = 0.0;
+	for (j = 0; j < FP_PEAKS; j++) {
+	    if (b->freq[j] <= 0.0)
+		continue;
+	    d = log2_ratio(a->freq[i], b->freq[j]);
+	    if (partner < 0 || d < best) {
+		best = d;
+		partner = j;
+	    }
+	}
+
+	w = pow(10.0, a->level[i] / 20.0);
+	if (partner < 0)
+	    cost += w * FP_NO_MATCH;
+	else
+	    cost += w * (best + 0.25 * log2_ratio(a->decay[i], b->decay[partner]));
+	weight += w;
+    }
+
+    return weight > 0.0 ? cost / weight : 0.0;
+}
+
+gdouble
+fingerprint_distance (const PsiFingerprint *a, const PsiFingerprint *b)
+{
+    return 0.5 * (peaks_cost(a, b) + peaks_cost(b, a)) +
+	0.5 * log2_ratio(a->centroid, b->centroid) +
+	0.25 * log2_ratio(a->decay_all, b->decay_all);
+}
@@ -0,0 +1,45 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_FINGERPRINT
+#define _PSI_FINGERPRINT
+
+#include <glib.h>
+
+/* Number of modal peaks kept per sound */
+#define FP_PEAKS 6
+
+/* Compact spectral summary of a (normalized) sound, used to find
+   instruments that sound alike */
+typedef struct _PsiFingerprint
+{
+    gfloat	freq[FP_PEAKS];		/* Hz, ascending, 0.0 if unused */
+    gfloat	level[FP_PEAKS];	/* dB relative to the strongest peak */
+    gfloat	decay[FP_PEAKS];	/* s to fall by 60 dB */
+    gfloat	centroid;		/* Hz */
+    gfloat	decay_all;		/* s for the whole sound to fall by 60 dB */
+} PsiFingerprint;
+
+void		fingerprint_compute	(PsiFingerprint *fp, const gdouble *samples,
+					 gint n, gint rate);
+/* 0.0 for identical sounds, roughly the mismatch in octaves otherwise */
+gdouble		fingerprint_distance	(const PsiFingerprint *a,
+					 const PsiFingerprint *b);
+
+#endif
@@ -0,0 +1,365 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Fitting instruments to a recording.  A (mu + lambda) evolution strategy
+   mutates parameter vectors normalized to [0, 1]; every generation the new
+   candidates are rendered and fingerprinted on a thread pool with one
+   worker per processor.  Early generations render only the first fraction
+   of a second and compare it with the same stretch of the target, which
+   is enough to place the partials; the last ones render the full
+   LIBRARY_FP_SECONDS so the decay is matched as well. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "fit.h"
+#include "fingerprint.h"
+#include "library.h"
+#include "similar.h"
+#include "main.h"
+
+#define FIT_PARENTS 6
+#define FIT_OFFSPRING 24
+/* Mutation step in normalized units, shrinking geometrically */
+#define FIT_SIGMA_START 0.3
+#define FIT_SIGMA_END 0.02
+/* Fixed so a fit can be repeated on any machine */
+#define FIT_SEED 0x5053494c
+/* Given to renders which blow up */
+#define FIT_WORST 1e6
+
+/* Render lengths in seconds, the generations are split evenly among them */
+static const gdouble stages[] = {0.25, 0.5, 1.0, LIBRARY_FP_SECONDS};
+#define FIT_STAGES ((gint) G_N_ELEMENTS(stages))
+
+typedef enum {
+    FIT_TYPE,
+    FIT_HEIGHT,
+    FIT_CIRCUM,
+    FIT_LENGTH,
+    FIT_PLANE_LENGTH,
+    FIT_PLANE_WIDTH,
+    FIT_TENSION,
+    FIT_SPEED,
+    FIT_DAMPING,
+    FIT_ACTUATION,
+    FIT_PARAMS
+} FitParam;
+
+typedef struct _FitRange
+{
+    gdouble	min, max;
+    gboolean	log;	/* sizes and rates are searched on a log scale */
+} FitRange;
+
+/* Type and actuation are categories: [0, 1) is cut into equal parts */
+static const FitRange ranges[FIT_PARAMS] = {
+    { 0.0, 1.0, FALSE },
+    { PRESET_SIZE_MIN, PRESET_TUBE_MAX, TRUE },
+    { PRESET_SIZE_MIN, PRESET_TUBE_MAX, TRUE },
+    { PRESET_SIZE_MIN, PRESET_ROD_MAX, TRUE },
+    { PRESET_SIZE_MIN, PRESET_PLANE_LENGTH_MAX, TRUE },
+    { PRESET_SIZE_MIN, PRESET_PLANE_WIDTH_MAX, TRUE },
+    { PRESET_TENSION_MIN, PRESET_TENSION_MAX, TRUE },
+    { PRESET_SPEED_MIN, PRESET_SPEED_MAX, FALSE },
+    { PRESET_DAMPING_MIN, PRESET_DAMPING_MAX, TRUE },
+    { 0.0, 1.0, FALSE }
+};
+
+typedef struct _FitCandidate
+{
+    gdouble	x[FIT_PARAMS];
+    PsiPreset	preset;		/* x decoded */
+    gint	stage;		/* the distance is for this stage, -1 if none */
+    gdouble	distance;
+} FitCandidate;
+
+typedef struct _FitContext
+{
+    PsiFingerprint	target[FIT_STAGES];
+    GAsyncQueue		*done;	/* evaluated candidates */
+} FitContext;
+
+static gdouble
+fit_value (const gdouble *x, FitParam p)
+{
+    const FitRange *r = &ranges[p];
+
+    if (r->log)
+	return r->min * pow(r->max / r->min, x[p]);
+    return r->min + (r->max - r->min) * x[p];
+}
+
+static gdouble
+fit_position (gdouble value, FitParam p)
+{
+    const FitRange *r = &ranges[p];
+
+    if (r->log)
+	return CLAMP(log(value / r->min) / log(r->max / r->min), 0.0, 1.0);
+    return CLAMP((value - r->min) / (r->max - r->min), 0.0, 1.0);
+}
+
+static gint
+fit_size (const gdouble *x, FitParam p)
+{
+    return (gint) floor(fit_value(x, p) + 0.5);
+}
+
+static void
+fit_decode (FitCandidate *c)
+{
+    PsiPreset *p = &c->preset;
+
+    preset_init(p);
+    p->type = MIN((gint) (c->x[FIT_TYPE] * PRESET_TYPES), PRESET_TYPES - 1);
+    p->height = fit_size(c->x, FIT_HEIGHT);
+    p->circum = fit_size(c->x, FIT_CIRCUM);
+    p->length = fit_size(c->x, FIT_LENGTH);
+    p->plane_length = fit_size(c->x, FIT_PLANE_LENGTH);
+    p->plane_width = fit_size(c->x, FIT_PLANE_WIDTH);
+    p->tension = fit_value(c->x, FIT_TENSION);
+    p->speed = fit_value(c->x, FIT_SPEED);
+    p->damping = fit_value(c->x, FIT_DAMPING);
+    p->actuation = c->x[FIT_ACTUATION] >= 0.5;
+}
+
+static void
+fit_encode (FitCandidate *c, const PsiPreset *p)
+{
+    c->x[FIT_TYPE] = (p->type + 0.5) / PRESET_TYPES;
+    c->x[FIT_HEIGHT] = fit_position(p->height, FIT_HEIGHT);
+    c->x[FIT_CIRCUM] = fit_position(p->circum, FIT_CIRCUM);
+    c->x[FIT_LENGTH] = fit_position(p->length, FIT_LENGTH);
+    c->x[FIT_PLANE_LENGTH] = fit_position(p->plane_length, FIT_PLANE_LENGTH);
+    c->x[FIT_PLANE_WIDTH] = fit_position(p->plane_width, FIT_PLANE_WIDTH);
+    c->x[FIT_TENSION] = fit_position(p->tension, FIT_TENSION);
+    c->x[FIT_SPEED] = fit_position(p->speed, FIT_SPEED);
+    c->x[FIT_DAMPING] = fit_position(p->damping, FIT_DAMPING);
+    c->x[FIT_ACTUATION] = p->actuation ? 0.75 : 0.25;
+}
+
+/* Standard normal deviate (Box-Muller) */
+static gdouble
+fit_gauss (GRand *rand)
+{
+    gdouble u = 1.0 - g_rand_double(rand);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * G_PI * g_rand_double(rand));
+}
+
+static void
+fit_mutate (FitCandidate *child, const FitCandidate *parent, gdouble sigma,
+	    GRand *rand)
+{
+    gdouble	v;
+    gint	p;
+
+    for (p = 0; p < FIT_PARAMS; p++) {
+	v = parent->x[p] + sigma * fit_gauss(rand);
+	/* Reflect at the ends of the range */
+	if (v < 0.0)
+	    v = -v;
+	if (v > 1.0)
+	    v = 2.0 - v;
+	child->x[p] = CLAMP(v, 0.0, 1.0 - 1e-9);
+    }
+    child->stage = -1;
+}
+
+/* Thread pool worker */
+static void
+fit_evaluate (gpointer data, gpointer user_data)
+{
+    FitCandidate	*c = data;
+    FitContext		*ctx = user_data;
+    PsiFingerprint	fp;
+    gdouble		*samples;
+    gint		len, n;
+
+    len = (gint) (LIBRARY_FP_RATE * stages[c->stage]);
+    samples = g_new(gdouble, len);
+    n = preset_render(&c->preset, LIBRARY_FP_RATE, len, samples, 0.0,
+		      NULL, NULL, NULL);
+    if (n != PS_RENDER_UNSTABLE) {
+	fingerprint_compute(&fp, samples, n, LIBRARY_FP_RATE);
+	c->distance = fingerprint_distance(&fp, &ctx->target[c->stage]);
+    } else
+	c->distance = FIT_WORST;
+    g_free(samples);
+
+    if (!isfinite(c->distance))
+	c->distance = FIT_WORST;
+
+    g_async_queue_push(ctx->done, c);
+}
+
+static int
+fit_compare (const void *a, const void *b)
+{
+    gdouble da = ((const FitCandidate *) a)->distance;
+    gdouble db = ((const FitCandidate *) b)->distance;
+
+    return da < db ? -1 : da > db;
+}
+
+gdouble
+fit_preset (PsiPreset *best, PsiPresetType type, const gdouble *target,
+	    gint n, gint rate, gint generations, PsiFitProgress *progress,
+	    gpointer data)
+{
+    FitContext		ctx;
+    FitCandidate	*pop;
+    PsiPreset		defaults;
+    GThreadPool		*pool;
+    GRand		*rand;
+    gdouble		sigma, distance;
+    gint		total = FIT_PARENTS + FIT_OFFSPRING;
+    gint		g, i, p, stage, pending;
+
+    for (stage = 0; stage < FIT_STAGES; stage++)
+	fingerprint_compute(&ctx.target[stage], target,
+			    MIN(n, (gint) (rate * stages[stage])), rate);
+
+    ctx.done = g_async_queue_new();
+    pool = g_thread_pool_new(fit_evaluate, &ctx, g_get_num_processors(),
+			     FALSE, NULL);
+    rand = g_rand_new_with_seed(FIT_SEED);
+    pop = g_new(FitCandidate, total);
+
+    /* The defaults, and the rest spread over the whole range */
+    preset_init(&defaults);
+    fit_encode(&pop[0], &defaults);
+    for (i = 1; i < total; i++)
+	for (p = 0; p < FIT_PARAMS; p++)
+	    pop[i].x[p] = g_rand_double(rand);
+    for (i = 0; i < total; i++)
+	pop[i].stage = -1;
+
+    for (g = 0; g < generations; g++) {
+	stage = g * FIT_STAGES / generations;
+	sigma = FIT_SIGMA_START *
+	    pow(FIT_SIGMA_END / FIT_SIGMA_START, (gdouble) g / MAX(generations - 1, 1));
+
+	/* The best FIT_PARENTS survive and breed */
+	if (g > 0)
+	    for (i = FIT_PARENTS; i < total; i++)
+		fit_mutate(&pop[i], &pop[g_rand_int_range(rand, 0, FIT_PARENTS)],
+			   sigma, rand);
+
+	/* Parents are scored again only when the renders get longer */
+	pending = 0;
+	for (i = 0; i < total; i++) {
+	    if (pop[i].stage == stage)
+		continue;
+	    if (type < PRESET_TYPES)
+		pop[i].x[FIT_TYPE] = (type + 0.5) / PRESET_TYPES;
+	    fit_decode(&pop[i]);
+	    pop[i].stage = stage;
+	    g_thread_pool_push(pool, &pop[i], NULL);
+	    pending++;
+	}
+	while (pending-- > 0)
+	    g_async_queue_pop(ctx.done);
+
+	qsort(pop, total, sizeof(FitCandidate), fit_compare);
+	if (progress)
+	    progress(g, generations, &pop[0].preset, pop[0].distance, data);
+    }
+
+    *best = pop[0].preset;
+    distance = pop[0].distance;
+
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_async_queue_unref(ctx.done);
+    g_rand_free(rand);
+    g_free(pop);
+
+    return distance;
+}
+
+static void
+fit_progress (gint generation, gint generations, const PsiPreset *best,
+	      gdouble distance, gpointer data)
+{
+    fprintf(stderr, _("Generation %d/%d: best %s at %.3f\n"), generation + 1,
+	    generations, preset_type_name(best->type), distance);
+}
+
+int
+fit_main (int argc, char *argv[])
+{
+    PsiPreset		preset;
+    PsiPresetType	type = PRESET_TYPES;
+    gdouble		*samples, distance;
+    gchar		*output, *dot;
+    gint		n, rate;
+
+    if (argc < 2 || argc > 4) {
+	fprintf(stderr, _("Usage: %s --fit TARGET [OUTPUT [tube|rod|plane]]\n"),
+		PACKAGE);
+	return 2;
+    }
+
+    if (argc > 3) {
+	for (type = 0; type < PRESET_TYPES; type++)
+	    if (!g_ascii_strcasecmp(argv[3], preset_type_name(type)))
+		break;
+	if (type == PRESET_TYPES) {
+	    fprintf(stderr, _("Unknown instrument type %s\n"), argv[3]);
+	    return 2;
+	}
+    }
+
+    samples = similar_read_sound(argv[1], LIBRARY_FP_SECONDS, &n, &rate);
+    if (samples == NULL) {
+	fprintf(stderr, _("Could not read %s\n"), argv[1]);
+	return 1;
+    }
+
+    /* By default TARGET's name with the extension replaced, in the
+       current directory */
+    if (argc > 2)
+	output = g_strdup(argv[2]);
+    else {
+	output = g_path_get_basename(argv[1]);
+	if ((dot = strrchr(output, '.')) != NULL && dot != output)
+	    *dot = '\0';
+	dot = output;
+	output = g_strconcat(dot, ".psii", NULL);
+	g_free(dot);
+    }
+
+    distance = fit_preset(&preset, type, samples, n, rate, FIT_GENERATIONS,
+			  fit_progress, NULL);
+    g_free(samples);
+
+    preset_save(&preset, output);
+    printf("%8.3f  %s\n", distance, output);
+    g_free(output);
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_FIT
+#define _PSI_FIT
+
+#include <glib.h>
+
+#include "preset.h"
+
+/* Generations searched unless told otherwise */
+#define FIT_GENERATIONS 32
+
+/* Called on the calling thread after every generation */
+typedef void PsiFitProgress (gint generation, gint generations,
+			     const PsiPreset *best, gdouble distance,
+			     gpointer data);
+
+/* Searches for the instrument which sounds most like target, n samples
+   at rate, normalized.  type is PRESET_TYPES to search all kinds of
+   instrument.  The best preset is stored in best; returns its
+   fingerprint_distance() from the target. */
+gdouble		fit_preset		(PsiPreset *best, PsiPresetType type,
+					 const gdouble *target, gint n, gint rate,
+					 gint generations, PsiFitProgress *progress,
+					 gpointer data);
+
+/* psindustrializer --fit TARGET [OUTPUT [TYPE]]: writes the instrument
+   which sounds most like the sound file TARGET.  Returns the exit status. */
+int		fit_main		(int argc, char *argv[]);
+
+#endif
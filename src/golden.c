@@ -0,0 +1,429 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* Render regression checks.  A reference file is written from a tree
+   known to be good and checked against by later ones.  For every
+   instrument of a fixed set it stores a SHA-256 of the normalized render,
+   the smallest and largest sample of every GOLDEN_BLOCK samples, and the
+   render's fingerprint.  The default Euler render must match the hash
+   bit for bit; other integrators, and any run given tolerances, may
+   differ by at most MAX_ABS in the envelope and DISTANCE between the
+   fingerprints.  The file is a GKeyFile, one group per instrument, so
+   instruments can be added without invalidating the others. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "golden.h"
+#include "bench.h"
+#include "fingerprint.h"
+#include "preset.h"
+#include "main.h"
+
+#define GOLDEN_VERSION 1
+#define GOLDEN_RATE 44100
+#define GOLDEN_SECONDS 0.25
+/* Samples per envelope point */
+#define GOLDEN_BLOCK 64
+/* Default tolerances for the integrators which can't match Euler
+   exactly: about -40 dB in the envelope, and a sixth of a semitone */
+#define GOLDEN_MAX_ABS 0.01
+#define GOLDEN_DISTANCE 0.01
+
+typedef struct _GoldenCase
+{
+    PsiPresetType	type;
+    gint		size[2];	/* second one unused for rods */
+    gdouble		tension, speed, damping;
+    gint		actuation;
+    gdouble		velocity;
+} GoldenCase;
+
+/* Every kind of object at the GUI's extremes and in between, at the
+   default settings and at the ones that stress the renderer most */
+static const GoldenCase cases[] = {
+    { PRESET_TUBE, { PRESET_SIZE_MIN, PRESET_SIZE_MIN }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_TUBE, { 10, 10 }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_TUBE, { PRESET_TUBE_MAX, PRESET_TUBE_MAX }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_TUBE, { 10, 10 }, 4.0, 0.2, 0.05, 1, 3.0 },
+    { PRESET_ROD, { PRESET_SIZE_MIN }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_ROD, { 20 }, PRESET_TENSION_MIN, 0.2, PRESET_DAMPING_MAX, 0, 1.0 },
+    { PRESET_ROD, { PRESET_ROD_MAX }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_PLANE, { PRESET_SIZE_MIN, PRESET_SIZE_MIN }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_PLANE, { 10, 13 }, 4.0, 0.2, 0.05, 0, 1.0 },
+    { PRESET_PLANE, { 10, 13 }, PRESET_TENSION_MAX, PRESET_SPEED_MAX,
+      PRESET_DAMPING_MIN, 0, 1.0 },
+    { PRESET_PLANE, { PRESET_PLANE_LENGTH_MAX, PRESET_PLANE_WIDTH_MAX }, 4.0,
+      0.2, 0.05, 0, 1.0 }
+};
+
+/* What is kept of one render */
+typedef struct _GoldenTake
+{
+    gint		samples;
+    gchar		*sha256;
+    gdouble		*envelope;	/* min and max of every block */
+    gsize		envelope_len;
+    PsiFingerprint	fp;
+} GoldenTake;
+
+static void
+golden_preset (const GoldenCase *c, PsiPreset *preset)
+{
+    preset_init(preset);
+    preset->type = c->type;
+    preset->height = preset->plane_length = preset->length = c->size[0];
+    preset->circum = preset->plane_width = c->size[1];
+    preset->tension = c->tension;
+    preset->speed = c->speed;
+    preset->damping = c->damping;
+    preset->actuation = c->actuation;
+    preset->velocity = c->velocity;
+}
+
+/* Also the group name in the reference file */
+static gchar*
+golden_case_name (const GoldenCase *c)
+{
+    gchar	size[32];
+
+    if (c->type == PRESET_ROD)
+	g_snprintf(size, sizeof(size), "%d", c->size[0]);
+    else
+	g_snprintf(size, sizeof(size), "%dx%d", c->size[0], c->size[1]);
+
+    return g_strdup_printf("%s %s tension=%g speed=%g damping=%g actuation=%d velocity=%g",
+			   preset_type_name(c->type), size, c->tension,
+			   c->speed, c->damping, c->actuation, c->velocity);
+}
+
+static void
+golden_take_free (GoldenTake *take)
+{
+    g_free(take->sha256);
+    g_free(take->envelope);
+}
+
+/* FALSE if the render blew up */
+static gboolean
+golden_render (const GoldenCase *c, PSMetalObjIntegrator integrator,
+	       GoldenTake *take)
+{
+    PsiPreset		preset;
+    PSRenderOptions	opts;
+    GChecksum		*sum;
+    gdouble		*samples, lo, hi;
+    guint64		bits;
+    gint		len, i, j;
+
+    golden_preset(c, &preset);
+    memset(&opts, 0, sizeof(opts));
+    opts.integrator = integrator;
+
+    len = (gint) (GOLDEN_RATE * GOLDEN_SECONDS);
+    samples = g_new(gdouble, len);
+    take->samples = preset_render(&preset, GOLDEN_RATE, len, samples, 0.0,
+				  NULL, NULL, &opts);
+    if (take->samples == PS_RENDER_UNSTABLE) {
+	g_free(samples);
+	return FALSE;
+    }
+
+    /* Little endian, so the hashes don't depend on the host */
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+    for (i = 0; i < take->samples; i++) {
+	memcpy(&bits, &samples[i], sizeof(bits));
+	bits = GUINT64_TO_LE(bits);
+	g_checksum_update(sum, (const guchar *) &bits, sizeof(bits));
+    }
+    take->sha256 = g_strdup(g_checksum_get_string(sum));
+    g_checksum_free(sum);
+
+    take->envelope_len = 2 * ((take->samples + GOLDEN_BLOCK - 1) / GOLDEN_BLOCK);
+    take->envelope = g_new(gdouble, MAX(take->envelope_len, 1));
+    for (i = 0; i < take->samples; i += GOLDEN_BLOCK) {
+	lo = hi = samples[i];
+	for (j = i + 1; j < MIN(i + GOLDEN_BLOCK, take->samples); j++) {
+	    lo = MIN(lo, samples[j]);
+	    hi = MAX(hi, samples[j]);
+	}
+	take->envelope[2 * (i / GOLDEN_BLOCK)] = lo;
+	take->envelope[2 * (i / GOLDEN_BLOCK) + 1] = hi;
+    }
+
+    fingerprint_compute(&take->fp, samples, take->samples, GOLDEN_RATE);
+    g_free(samples);
+
+    return TRUE;
+}
+
+static void
+golden_fingerprint_to_list (const PsiFingerprint *fp, gdouble *list)
+{
+    gint	i;
+
+    for (i = 0; i < FP_PEAKS; i++) {
+	list[3 * i] = fp->freq[i];
+	list[3 * i + 1] = fp->level[i];
+	list[3 * i + 2] = fp->decay[i];
+    }
+    list[3 * FP_PEAKS] = fp->centroid;
+    list[3 * FP_PEAKS + 1] = fp->decay_all;
+}
+
+static void
+golden_fingerprint_from_list (PsiFingerprint *fp, const gdouble *list)
+{
+    gint	i;
+
+    for (i = 0; i < FP_PEAKS; i++) {
+	fp->freq[i] = list[3 * i];
+	fp->level[i] = list[3 * i + 1];
+	fp->decay[i] = list[3 * i + 2];
+    }
+    fp->centroid = list[3 * FP_PEAKS];
+    fp->decay_all = list[3 * FP_PEAKS + 1];
+}
+
+#define GOLDEN_FP_LEN (3 * FP_PEAKS + 2)
+
+static void
+golden_take_store (GKeyFile *keys, const gchar *group, const GoldenTake *take)
+{
+    gdouble	fp[GOLDEN_FP_LEN];
+
+    g_key_file_set_integer(keys, group, "samples", take->samples);
+    g_key_file_set_string(keys, group, "sha256", take->sha256);
+    g_key_file_set_double_list(keys, group, "envelope", take->envelope,
+			       take->envelope_len);
+    golden_fingerprint_to_list(&take->fp, fp);
+    g_key_file_set_double_list(keys, group, "fingerprint", fp, GOLDEN_FP_LEN);
+}
+
+/* FALSE if group is missing or damaged */
+static gboolean
+golden_take_load (GKeyFile *keys, const gchar *group, GoldenTake *take)
+{
+    gdouble	*fp;
+    gsize	len = 0;
+
+    memset(take, 0, sizeof(*take));
+    take->samples = g_key_file_get_integer(keys, group, "samples", NULL);
+    take->sha256 = g_key_file_get_string(keys, group, "sha256", NULL);
+    take->envelope = g_key_file_get_double_list(keys, group, "envelope",
+						&take->envelope_len, NULL);
+    fp = g_key_file_get_double_list(keys, group, "fingerprint", &len, NULL);
+    if (fp && len == GOLDEN_FP_LEN)
+	golden_fingerprint_from_list(&take->fp, fp);
+    g_free(fp);
+
+    return take->sha256 != NULL && take->envelope != NULL &&
+	take->envelope_len == 2 * ((take->samples + GOLDEN_BLOCK - 1) / GOLDEN_BLOCK) &&
+	len == GOLDEN_FP_LEN;
+}
+
+/* Largest difference between the envelopes; a render that ends early
+   is taken to be silent after its end */
+static gdouble
+golden_max_abs (const GoldenTake *a, const GoldenTake *b)
+{
+    gdouble	va, vb, diff = 0.0;
+    gsize	i;
+
+    for (i = 0; i < MAX(a->envelope_len, b->envelope_len); i++) {
+	va = i < a->envelope_len ? a->envelope[i] : 0.0;
+	vb = i < b->envelope_len ? b->envelope[i] : 0.0;
+	diff = MAX(diff, fabs(va - vb));
+    }
+
+    return diff;
+}
+
+static int
+golden_write (const gchar *fname)
+{
+    GKeyFile	*keys;
+    GoldenTake	take;
+    GError	*error = NULL;
+    gchar	*name, *data;
+    gsize	len;
+    guint	i;
+    int		status = 0;
+
+    keys = g_key_file_new();
+    g_key_file_set_integer(keys, "golden", "version", GOLDEN_VERSION);
+    g_key_file_set_integer(keys, "golden", "rate", GOLDEN_RATE);
+    g_key_file_set_double(keys, "golden", "seconds", GOLDEN_SECONDS);
+
+    for (i = 0; i < G_N_ELEMENTS(cases); i++) {
+	name = golden_case_name(&cases[i]);
+	if (golden_render(&cases[i], PS_METAL_OBJ_EULER, &take)) {
+	    golden_take_store(keys, name, &take);
+	    golden_take_free(&take);
+	    printf("%s\n", name);
+	} else {
+	    fprintf(stderr, _("%s is unstable, left out\n"), name);
+	    status = 1;
+	}
+	g_free(name);
+    }
+
+    data = g_key_file_to_data(keys, &len, NULL);
+    if (!g_file_set_contents(fname, data, len, &error)) {
+	fprintf(stderr, "%s\n", error->message);
+	g_error_free(error);
+	status = 1;
+    }
+    g_free(data);
+    g_key_file_free(keys);
+
+    return status;
+}
+
+/* A negative max_abs asks for the exact render */
+static int
+golden_check (const gchar *fname, PSMetalObjIntegrator integrator,
+	      gdouble max_abs, gdouble distance)
+{
+    GKeyFile	*keys;
+    GoldenTake	ref, take;
+    GError	*error = NULL;
+    gchar	*name;
+    gdouble	diff, dist;
+    gboolean	exact, ok;
+    guint	i;
+    gint	failed = 0;
+
+    keys = g_key_file_new();
+    if (!g_key_file_load_from_file(keys, fname, G_KEY_FILE_NONE, &error)) {
+	fprintf(stderr, "%s\n", error->message);
+	g_error_free(error);
+	g_key_file_free(keys);
+	return 2;
+    }
+
+    if (g_key_file_get_integer(keys, "golden", "version", NULL) != GOLDEN_VERSION ||
+	g_key_file_get_integer(keys, "golden", "rate", NULL) != GOLDEN_RATE ||
+	g_key_file_get_double(keys, "golden", "seconds", NULL) != GOLDEN_SECONDS) {
+	fprintf(stderr, _("%s was written by another version, write it again\n"),
+		fname);
+	g_key_file_free(keys);
+	return 2;
+    }
+
+    printf("%-8s %10s %10s  %s\n", _("result"), "max-abs", "distance",
+	   _("instrument"));
+
+    for (i = 0; i < G_N_ELEMENTS(cases); i++) {
+	name = golden_case_name(&cases[i]);
+
+	if (!golden_take_load(keys, name, &ref)) {
+	    printf("%-8s %10s %10s  %s\n", _("missing"), "-", "-", name);
+	    failed++;
+	} else if (!golden_render(&cases[i], integrator, &take)) {
+	    printf("%-8s %10s %10s  %s\n", _("unstable"), "-", "-", name);
+	    failed++;
+	} else {
+	    exact = take.samples == ref.samples && !strcmp(take.sha256, ref.sha256);
+	    diff = golden_max_abs(&take, &ref);
+	    dist = fingerprint_distance(&take.fp, &ref.fp);
+
+	    if (max_abs < 0.0)
+		ok = exact;
+	    else
+		ok = diff <= max_abs && dist <= distance;
+	    if (!ok)
+		failed++;
+
+	    printf("%-8s %10.3g %10.3g  %s\n",
+		   !ok ? _("FAIL") : exact ? _("exact") : _("ok"),
+		   diff, dist, name);
+	    golden_take_free(&take);
+	}
+
+	golden_take_free(&ref);
+	g_free(name);
+    }
+
+    g_key_file_free(keys);
+
+    if (failed)
+	printf(_("%d of %d renders differ from %s\n"), failed,
+	       (gint) G_N_ELEMENTS(cases), fname);
+
+    return failed ? 1 : 0;
+}
+
+int
+golden_main (int argc, char *argv[])
+{
+    PSMetalObjIntegrator	integrator = PS_METAL_OBJ_EULER;
+    gdouble			max_abs = -1.0, distance = 0.0;
+    gchar			*end;
+
+    if (argc == 3 && !strcmp(argv[1], "write"))
+	return golden_write(argv[2]);
+
+    if (argc < 3 || argc == 5 || argc > 6 || strcmp(argv[1], "check")) {
+	fprintf(stderr, _("Usage: %s --golden write FILE\n"
+			  "       %s --golden check FILE [INTEGRATOR [MAX_ABS DISTANCE]]\n"),
+		PACKAGE, PACKAGE);
+	return 2;
+    }
+
+    if (argc > 3) {
+	for (integrator = 0; integrator < BENCH_INTEGRATORS; integrator++)
+	    if (!strcmp(argv[3], bench_integrator_name(integrator)))
+		break;
+	if (integrator == BENCH_INTEGRATORS) {
+	    fprintf(stderr, _("%s is not an integrator\n"), argv[3]);
+	    return 2;
+	}
+
+	/* Only Euler renders what the references were made with */
+	if (integrator != PS_METAL_OBJ_EULER) {
+	    max_abs = GOLDEN_MAX_ABS;
+	    distance = GOLDEN_DISTANCE;
+	}
+    }
+
+    if (argc > 4) {
+	max_abs = g_ascii_strtod(argv[4], &end);
+	if (*end || max_abs < 0.0) {
+	    fprintf(stderr, _("%s is not a tolerance\n"), argv[4]);
+	    return 2;
+	}
+	distance = g_ascii_strtod(argv[5], &end);
+	if (*end || distance < 0.0) {
+	    fprintf(stderr, _("%s is not a tolerance\n"), argv[5]);
+	    return 2;
+	}
+    }
+
+    return golden_check(argv[2], integrator, max_abs, distance);
+}
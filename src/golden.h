@@ -0,0 +1,32 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PSI_GOLDEN
+#define _PSI_GOLDEN
+
+/* psindustrializer --golden write FILE
+   psindustrializer --golden check FILE [INTEGRATOR [MAX_ABS DISTANCE]]
+
+   Renders a fixed set of instruments and either stores what they sound
+   like in FILE, or compares them to what FILE holds.  Returns the exit
+   status: 1 if a render differs more than allowed. */
+int		golden_main		(int argc, char *argv[]);
+
+#endif
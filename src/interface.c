@@ -21,6 +21,7 @@
 #  include <config.h>
 #endif
 
+#include <string.h>
 #include <gtk/gtk.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gdk/gdkkeysyms.h>
@@ -28,6 +29,7 @@
 #include "callbacks.h"
 #include "interface.h"
 #include "main.h"
+#include "library.h"
 
 GtkWidget *status_label, *progressbar1;
 GSList *driver_list;
@@ -40,7 +42,12 @@ static GtkWidget *speed_hscale, *damping_hscale, *actuation_combo, *velocity_hsc
 static GtkWidget *play, *save;
 
 static guint	preselected_driver;
-static gboolean	autocorrect_ext, overwarning;
+static gboolean	autocorrect_ext, overwarning, play_overlap, render_log, dither,
+		reduced_rate;
+static PsiExportFormat	export_format;
+static gint	render_rate;
+
+static const gint rates[] = { 22050, 32000, 44100, 48000, 88200, 96000 };
 
 void gui_set_sensitive(gboolean sens)
 {
@@ -90,6 +97,13 @@ void gui_set_size_label (gfloat value)
     g_free(size_str);
 }
 
+void gui_set_status (const gchar *msg)
+{
+    /* May be called before the main window exists */
+    if (status_label)
+	gtk_label_set_text(GTK_LABEL(status_label), msg);
+}
+
 static inline
 GtkWidget* dialog_add_stock_button(GtkDialog* dialog, const gchar* stock_id, gint response)
 {
@@ -115,9 +129,18 @@ static void hang_tooltip(GtkWidget * widget, const gchar * text)
 static void setup_clicked(GtkWidget * setup_win, gint response, gpointer data)
 {
     if (response == GTK_RESPONSE_OK) {
+	if (render_rate != conf_rate || reduced_rate != conf_reduced_rate)
+	    render_settings_changed();
+	/* Before the driver is reopened, so it opens at the new rate */
+	conf_rate = render_rate;
+	conf_reduced_rate = reduced_rate;
 	psi_set_driver(preselected_driver);
 	conf_autoext = autocorrect_ext;
 	conf_overwrite_warning = overwarning;
+	conf_play_overlap = play_overlap;
+	conf_render_log = render_log;
+	conf_dither = dither;
+	conf_export_format = export_format;
     }
     
     gtk_widget_hide(setup_win);
@@ -129,6 +152,30 @@ driver_selected(GtkComboBox * combobox, gpointer data)
     preselected_driver = gtk_combo_box_get_active(combobox);
 }
 
+static void
+format_selected(GtkComboBox * combobox, gpointer data)
+{
+    export_format = gtk_combo_box_get_active(combobox);
+}
+
+static void
+rate_selected(GtkComboBox * combobox, gpointer data)
+{
+    render_rate = rates[gtk_combo_box_get_active(combobox)];
+}
+
+/* Index of the listed rate closest to the configured one */
+static gint rate_index(gint rate)
+{
+    gint i, best = 0;
+
+    for (i = 1; i < G_N_ELEMENTS(rates); i++)
+	if (ABS(rates[i] - rate) < ABS(rates[best] - rate))
+	    best = i;
+
+    return best;
+}
+
 static void descr_fill(drv * ldriver, GtkWidget *combo)
 {
     gtk_combo_box_append_text(GTK_COMBO_BOX(combo), ldriver->description);
@@ -141,7 +188,12 @@ static void checkbutton_changed(GtkToggleButton * tbutton, gboolean *value)
 
 static void setup_dialog(void)
 {
-    static GtkWidget *combo, *check_ext, *check_overwrite;
+    static GtkWidget *combo, *check_ext, *check_overwrite, *check_overlap, *check_log, *check_dither, *format_combo,
+		     *rate_combo, *check_reduced;
+    GtkWidget *hbox, *label;
+    PsiExportFormat format;
+    gchar *text;
+    gint i;
     static GtkWidget *setup_window = NULL;
 
     if(setup_window && GTK_IS_WIDGET(setup_window)) {
@@ -149,6 +201,13 @@ static void setup_dialog(void)
 	    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), psi_get_current_driver());
 	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_ext), conf_autoext);
 	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_overwrite), conf_overwrite_warning);
+	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_overlap), conf_play_overlap);
+	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_log), conf_render_log);
+	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_dither), conf_dither);
+	    gtk_combo_box_set_active(GTK_COMBO_BOX(format_combo), conf_export_format);
+	    gtk_combo_box_set_active(GTK_COMBO_BOX(rate_combo), rate_index(conf_rate));
+	    render_rate = conf_rate;
+	    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_reduced), conf_reduced_rate);
 	    gtk_widget_show(setup_window);
 	}
     } else {
@@ -195,10 +254,335 @@ static void setup_dialog(void)
 			 G_CALLBACK(checkbutton_changed),
 			 &overwarning);
 
+	check_overlap = gtk_check_button_new_with_label(_("Let a new strike overlap the sounding one"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_overlap),
+				     play_overlap = conf_play_overlap);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), check_overlap,
+		       TRUE, TRUE, 0);
+	gtk_widget_show(check_overlap);
+	g_signal_connect(check_overlap, "toggled",
+			 G_CALLBACK(checkbutton_changed),
+			 &play_overlap);
+
+	check_log = gtk_check_button_new_with_label(_("Log render times to renders.csv in the configuration folder"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_log),
+				     render_log = conf_render_log);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), check_log,
+		       TRUE, TRUE, 0);
+	gtk_widget_show(check_log);
+	g_signal_connect(check_log, "toggled",
+			 G_CALLBACK(checkbutton_changed),
+			 &render_log);
+
+	check_dither = gtk_check_button_new_with_label(_("Dither 16 and 24-bit samples"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_dither),
+				     dither = conf_dither);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), check_dither,
+		       TRUE, TRUE, 0);
+	gtk_widget_show(check_dither);
+	g_signal_connect(check_dither, "toggled",
+			 G_CALLBACK(checkbutton_changed),
+			 &dither);
+
+	hbox = gtk_hbox_new(FALSE, 4);
+	label = gtk_label_new(_("Save samples as:"));
+	gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 0);
+	format_combo = gtk_combo_box_new_text();
+	for (format = 0; export_format_available(format); format++)
+	    gtk_combo_box_append_text(GTK_COMBO_BOX(format_combo),
+				      export_format_description(format));
+	gtk_combo_box_set_active(GTK_COMBO_BOX(format_combo),
+				 export_format = conf_export_format);
+	gtk_box_pack_start(GTK_BOX(hbox), format_combo, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), hbox,
+		       TRUE, TRUE, 0);
+	g_signal_connect(format_combo, "changed",
+			 G_CALLBACK(format_selected),
+			 NULL);
+
+	hbox = gtk_hbox_new(FALSE, 4);
+	label = gtk_label_new(_("Sample rate:"));
+	gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, FALSE, 0);
+	rate_combo = gtk_combo_box_new_text();
+	for (i = 0; i < G_N_ELEMENTS(rates); i++) {
+	    text = g_strdup_printf(_("%d Hz"), rates[i]);
+	    gtk_combo_box_append_text(GTK_COMBO_BOX(rate_combo), text);
+	    g_free(text);
+	}
+	/* An unlisted rate from the config file is kept until one is picked */
+	render_rate = conf_rate;
+	gtk_combo_box_set_active(GTK_COMBO_BOX(rate_combo), rate_index(conf_rate));
+	gtk_box_pack_start(GTK_BOX(hbox), rate_combo, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), hbox,
+		       TRUE, TRUE, 0);
+	g_signal_connect(rate_combo, "changed",
+			 G_CALLBACK(rate_selected),
+			 NULL);
+
+	check_reduced = gtk_check_button_new_with_label(_("Simulate low and slow sounds at a lower rate"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_reduced),
+				     reduced_rate = conf_reduced_rate);
+	gtk_box_pack_start(GTK_BOX(GTK_DIALOG(setup_window)->vbox), check_reduced,
+		       TRUE, TRUE, 0);
+	g_signal_connect(check_reduced, "toggled",
+			 G_CALLBACK(checkbutton_changed),
+			 &reduced_rate);
+
 	gtk_widget_show_all(setup_window);
     }
 }
 
+enum {
+    LIBRARY_NAME,
+    LIBRARY_TYPE,
+    LIBRARY_SIZE,
+    LIBRARY_TENSION,
+    LIBRARY_SPEED,
+    LIBRARY_DAMPING,
+    LIBRARY_DISTANCE,
+    LIBRARY_INDEX,
+    LIBRARY_COLUMNS
+};
+
+#define LIBRARY_RESPONSE_SIMILAR 1
+
+static PsiLibrary *library = NULL;
+static gchar *library_root = NULL;
+/* Set while the list is ordered by likeness to the current take */
+static GArray *library_ranked = NULL;
+static GtkListStore *library_store;
+static GtkWidget *library_query, *library_count;
+
+static void library_filter(void)
+{
+    PsiLibraryQuery *query;
+    PsiLibraryEntry *entry;
+    GtkTreeIter iter;
+    gchar *error = NULL, *size, *tension, *speed, *damping, *distance, *count;
+    guint i, j, n = 0, total, unranked = 0;
+
+    gtk_list_store_clear(library_store);
+    if (!library)
+	return;
+
+    query = library_query_new(gtk_entry_get_text(GTK_ENTRY(library_query)), &error);
+    if (!query) {
+	gtk_label_set_text(GTK_LABEL(library_count), error);
+	g_free(error);
+	return;
+    }
+
+    total = library_ranked ? library_ranked->len : library->entries->len;
+    for (j = 0; j < total; j++) {
+	i = library_ranked ? g_array_index(library_ranked, PsiLibraryMatch, j).index : j;
+	entry = library_entry(library, i);
+	if (!library_query_match(query, entry))
+	    continue;
+
+	switch (entry->preset.type) {
+	case PRESET_TUBE:
+	    size = g_strdup_printf("%d x %d", entry->preset.height, entry->preset.circum);
+	    break;
+	case PRESET_PLANE:
+	    size = g_strdup_printf("%d x %d", entry->preset.plane_length, entry->preset.plane_width);
+	    break;
+	default:
+	    size = g_strdup_printf("%d", entry->preset.length);
+	    break;
+	}
+	tension = g_strdup_printf("%.2f", entry->preset.tension);
+	speed = g_strdup_printf("%.3f", entry->preset.speed);
+	damping = g_strdup_printf("%.4f", entry->preset.damping);
+	distance = library_ranked ?
+	    g_strdup_printf("%.3f", g_array_index(library_ranked, PsiLibraryMatch, j).distance) :
+	    g_strdup("");
+
+	gtk_list_store_append(library_store, &iter);
+	gtk_list_store_set(library_store, &iter,
+			   LIBRARY_NAME, entry->path,
+			   LIBRARY_TYPE, preset_type_name(entry->preset.type),
+			   LIBRARY_SIZE, size,
+			   LIBRARY_TENSION, tension,
+			   LIBRARY_SPEED, speed,
+			   LIBRARY_DAMPING, damping,
+			   LIBRARY_DISTANCE, distance,
+			   LIBRARY_INDEX, i,
+			   -1);
+	g_free(size);
+	g_free(tension);
+	g_free(speed);
+	g_free(damping);
+	g_free(distance);
+	n++;
+    }
+    library_query_free(query);
+
+    if (library_ranked)
+	unranked = library->entries->len - library_ranked->len;
+    if (unranked)
+	count = g_strdup_printf(_("%u of %u presets, %u without a fingerprint "
+				  "(psindustrializer --similar makes them)"),
+				n, library->entries->len, unranked);
+    else
+	count = g_strdup_printf(_("%u of %u presets"), n, library->entries->len);
+    gtk_label_set_text(GTK_LABEL(library_count), count);
+    g_free(count);
+}
+
+/* The library is the folder instruments were last loaded from or saved to */
+static void library_rescan(void)
+{
+    gchar *root, *index_file;
+
+    if (conf_instr_path)
+	root = g_filename_from_utf8(conf_instr_path, -1, NULL, NULL, NULL);
+    else
+	root = g_build_filename(g_get_home_dir(), "."PACKAGE, NULL);
+
+    /* Entry indices change */
+    if (library_ranked) {
+	g_array_free(library_ranked, TRUE);
+	library_ranked = NULL;
+    }
+
+    if (library && strcmp(library_root, root)) {
+	library_free(library);
+	library = NULL;
+	g_free(library_root);
+    }
+    if (!library) {
+	index_file = library_index_file(root);
+	library = library_open(index_file, root);
+	library_root = root;
+	g_free(index_file);
+    } else
+	g_free(root);
+
+    if (library_refresh(library) < 0)
+	gui_error_msg(_("Could not write the library index."));
+
+    library_filter();
+}
+
+static void
+library_activated(GtkTreeView * view, GtkTreePath * path,
+		  GtkTreeViewColumn * column, gpointer data)
+{
+    GtkTreeIter iter;
+    guint index;
+
+    if (gtk_tree_model_get_iter(GTK_TREE_MODEL(library_store), &iter, path)) {
+	gtk_tree_model_get(GTK_TREE_MODEL(library_store), &iter,
+			   LIBRARY_INDEX, &index, -1);
+	apply_preset(&library_entry(library, index)->preset);
+    }
+}
+
+static void library_rank_take(void)
+{
+    PsiFingerprint target;
+    const gfloat *take;
+    gdouble *normalized, gain;
+    gint n, take_rate, i;
+
+    if (!(take = current_take(&n, &take_rate, &gain))) {
+	gui_error_msg(_("Play the current sound first, there is nothing to compare with."));
+	return;
+    }
+
+    /* Fingerprints are taken from normalized sounds */
+    n = MIN(n, take_rate * LIBRARY_FP_SECONDS);
+    normalized = g_new(gdouble, MAX(n, 1));
+    for (i = 0; i < n; i++)
+	normalized[i] = take[i] * gain;
+    fingerprint_compute(&target, normalized, n, take_rate);
+    g_free(normalized);
+    if (library_ranked)
+	g_array_free(library_ranked, TRUE);
+    library_ranked = library_rank(library, &target);
+
+    library_filter();
+}
+
+static void library_clicked(GtkWidget * library_window, gint response, gpointer data)
+{
+    if (response == GTK_RESPONSE_APPLY)
+	library_rescan();
+    else if (response == LIBRARY_RESPONSE_SIMILAR)
+	library_rank_take();
+    else
+	gtk_widget_hide(library_window);
+}
+
+static void library_add_column(GtkWidget * view, const gchar * title, gint column)
+{
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(view), -1, title,
+						gtk_cell_renderer_text_new(),
+						"text", column, NULL);
+}
+
+static void library_dialog(void)
+{
+    static GtkWidget *library_window = NULL;
+    GtkWidget *vbox, *scrolled, *view;
+
+    if(library_window && GTK_IS_WIDGET(library_window)) {
+	if(!GTK_WIDGET_VISIBLE(library_window)) {
+	    library_rescan();
+	    gtk_widget_show(library_window);
+	}
+	return;
+    }
+
+    library_window = gtk_dialog_new();
+    g_signal_connect(library_window, "response",
+		     G_CALLBACK(library_clicked), NULL);
+    g_signal_connect(library_window, "delete-event",
+		     G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+
+    gtk_window_set_title(GTK_WINDOW(library_window), _("Instrument library"));
+
+    gtk_dialog_add_button(GTK_DIALOG(library_window), _("Sounds like this"),
+			  LIBRARY_RESPONSE_SIMILAR);
+    dialog_add_stock_button(GTK_DIALOG(library_window), GTK_STOCK_REFRESH, GTK_RESPONSE_APPLY);
+    dialog_add_stock_button(GTK_DIALOG(library_window), GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE);
+
+    vbox = GTK_DIALOG(library_window)->vbox;
+
+    library_query = gtk_entry_new();
+    gtk_box_pack_start(GTK_BOX(vbox), library_query, FALSE, FALSE, 0);
+    hang_tooltip(library_query, _("e.g. \"tubes with height > 20 and damping < 0.02\""));
+    g_signal_connect(library_query, "changed",
+		     G_CALLBACK(library_filter), NULL);
+
+    library_store = gtk_list_store_new(LIBRARY_COLUMNS, G_TYPE_STRING, G_TYPE_STRING,
+				       G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+				       G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
+    view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(library_store));
+    library_add_column(view, _("Instrument"), LIBRARY_NAME);
+    library_add_column(view, _("Type"), LIBRARY_TYPE);
+    library_add_column(view, _("Size"), LIBRARY_SIZE);
+    library_add_column(view, _("Tension"), LIBRARY_TENSION);
+    library_add_column(view, _("Speed"), LIBRARY_SPEED);
+    library_add_column(view, _("Damping"), LIBRARY_DAMPING);
+    library_add_column(view, _("Distance"), LIBRARY_DISTANCE);
+    g_signal_connect(view, "row-activated",
+		     G_CALLBACK(library_activated), NULL);
+
+    scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled),
+				   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scrolled, 520, 320);
+    gtk_container_add(GTK_CONTAINER(scrolled), view);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+    library_count = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(vbox), library_count, FALSE, FALSE, 0);
+
+    library_rescan();
+    gtk_widget_show_all(library_window);
+}
+
 static void
 dialog_clicked (GtkWidget *dialog)
 {
@@ -302,6 +686,8 @@ GtkWidget *gui_create_AppWindow(void)
     accel_group = gtk_accel_group_new();
     gtk_accel_group_connect(accel_group, GDK_KEY_space, 0, 0,
             g_cclosure_new(G_CALLBACK(on_space_pressed), NULL, NULL));
+    gtk_accel_group_connect(accel_group, GDK_KEY_Escape, 0, 0,
+            g_cclosure_new(G_CALLBACK(on_escape_pressed), NULL, NULL));
     gtk_window_add_accel_group(GTK_WINDOW(AppWindow), accel_group);
 
     vbox3 = gtk_vbox_new(FALSE, 0);
@@ -337,7 +723,7 @@ GtkWidget *gui_create_AppWindow(void)
     gtk_table_attach(GTK_TABLE(table1), label1, 0, 1, 0, 1,
 		     (GtkAttachOptions) (0), (GtkAttachOptions) (0), 0, 0);
 
-    height_spinbutton_adj = gtk_adjustment_new(10, 3, 30, 1, 10, 0);
+    height_spinbutton_adj = gtk_adjustment_new(10, PRESET_SIZE_MIN, PRESET_TUBE_MAX, 1, 10, 0);
     height_spinbutton =
 	gtk_spin_button_new(GTK_ADJUSTMENT(height_spinbutton_adj), 1, 0);
     gtk_widget_show(height_spinbutton);
@@ -345,7 +731,7 @@ GtkWidget *gui_create_AppWindow(void)
 		     (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
 		     (GtkAttachOptions) (0), 0, 0);
 
-    circum_spinbutton_adj = gtk_adjustment_new(5, 3, 30, 1, 10, 0);
+    circum_spinbutton_adj = gtk_adjustment_new(5, PRESET_SIZE_MIN, PRESET_TUBE_MAX, 1, 10, 0);
     circum_spinbutton =
 	gtk_spin_button_new(GTK_ADJUSTMENT(circum_spinbutton_adj), 1, 0);
     gtk_widget_show(circum_spinbutton);
@@ -372,7 +758,7 @@ GtkWidget *gui_create_AppWindow(void)
     gtk_table_attach(GTK_TABLE(table2), label15, 0, 1, 0, 1,
 		     (GtkAttachOptions) (0), (GtkAttachOptions) (0), 0, 0);
 
-    length_spinbutton_adj = gtk_adjustment_new(5, 3, 200, 1, 10, 0);
+    length_spinbutton_adj = gtk_adjustment_new(5, PRESET_SIZE_MIN, PRESET_ROD_MAX, 1, 10, 0);
     length_spinbutton =
 	gtk_spin_button_new(GTK_ADJUSTMENT(length_spinbutton_adj), 1, 0);
     gtk_widget_show(length_spinbutton);
@@ -404,7 +790,7 @@ GtkWidget *gui_create_AppWindow(void)
     gtk_table_attach(GTK_TABLE(table4), label18, 0, 1, 1, 2,
 		     (GtkAttachOptions) (0), (GtkAttachOptions) (0), 0, 0);
 
-    plane_length_spinbutton_adj = gtk_adjustment_new(7, 3, 30, 1, 10, 0);
+    plane_length_spinbutton_adj = gtk_adjustment_new(7, PRESET_SIZE_MIN, PRESET_PLANE_LENGTH_MAX, 1, 10, 0);
     plane_length_spinbutton =
 	gtk_spin_button_new(GTK_ADJUSTMENT(plane_length_spinbutton_adj), 1,
 			    0);
@@ -413,7 +799,7 @@ GtkWidget *gui_create_AppWindow(void)
 		     1, (GtkAttachOptions) (GTK_EXPAND | GTK_FILL),
 		     (GtkAttachOptions) (0), 0, 0);
 
-    plane_width_spinbutton_adj = gtk_adjustment_new(9, 3, 39, 1, 10, 0);
+    plane_width_spinbutton_adj = gtk_adjustment_new(9, PRESET_SIZE_MIN, PRESET_PLANE_WIDTH_MAX, 1, 10, 0);
     plane_width_spinbutton =
 	gtk_spin_button_new(GTK_ADJUSTMENT(plane_width_spinbutton_adj), 1,
 			    0);
@@ -474,7 +860,8 @@ GtkWidget *gui_create_AppWindow(void)
     speed_hscale =
 	gtk_hscale_new(GTK_ADJUSTMENT
 		       (adj =
-			gtk_adjustment_new(0.2, 0, 0.5, 0.01, 0.02, 0)));
+			gtk_adjustment_new(0.2, PRESET_SPEED_MIN,
+					   PRESET_SPEED_MAX, 0.01, 0.02, 0)));
     gtk_widget_show(speed_hscale);
     g_signal_connect(adj, "value-changed",
 		     G_CALLBACK(on_speed_hscale_focus_out_event), NULL);
@@ -486,8 +873,8 @@ GtkWidget *gui_create_AppWindow(void)
     damping_hscale =
 	gtk_hscale_new(GTK_ADJUSTMENT
 		       (adj =
-			gtk_adjustment_new(0.05, 0.005, 0.5, 0.001, 0.01,
-					   0)));
+			gtk_adjustment_new(0.05, PRESET_DAMPING_MIN,
+					   PRESET_DAMPING_MAX, 0.001, 0.01, 0)));
     gtk_widget_show(damping_hscale);
     g_signal_connect(adj, "value-changed",
 		     G_CALLBACK(on_damping_hscale_focus_out_event), NULL);
@@ -592,7 +979,7 @@ GtkWidget *gui_create_AppWindow(void)
     play = gtk_button_new_with_label(_("Play"));
     gtk_widget_show(play);
     gtk_table_attach_defaults(GTK_TABLE(table), play, 0, 1, 0, 1);
-    gtk_tooltips_set_tip(tooltips, play, _("Play rendered sound"), NULL);
+    gtk_tooltips_set_tip(tooltips, play, _("Play rendered sound (Esc stops)"), NULL);
 
     save = gtk_button_new_with_label(_("Save..."));
     gtk_widget_show(save);
@@ -622,6 +1009,12 @@ GtkWidget *gui_create_AppWindow(void)
     gtk_tooltips_set_tip(tooltips, thing, _("Load instrument as presets"), NULL);
     g_signal_connect(thing, "clicked", G_CALLBACK(load_ins_clicked), NULL);
 
+    thing = gtk_button_new_with_label(_("Library..."));
+    gtk_widget_show(thing);
+    gtk_table_attach_defaults(GTK_TABLE(table), thing, 2, 3, 1, 2);
+    gtk_tooltips_set_tip(tooltips, thing, _("Browse and search the instruments in the instrument folder"), NULL);
+    g_signal_connect(thing, "clicked", G_CALLBACK(library_dialog), NULL);
+
     thing = gtk_hbox_new(FALSE, 0);
     gtk_widget_show(thing);
     gtk_container_set_border_width(GTK_CONTAINER(thing), 5);
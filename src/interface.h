@@ -26,6 +26,7 @@ GtkWidget*		gui_ok_cancel_dialog (GtkWidget *dialog, const gchar *title, const g
 					      GCallback handler, gpointer data, gboolean default_button);
 
 void			gui_set_size_label (gfloat value);
+void			gui_set_status (const gchar *msg);
 
 void			gui_set_sensitive(gboolean sens);
 
@@ -77,9 +77,10 @@ static int jack_open(void)
     jack_set_process_callback(client, JACK_AudioCallback, 0);
     jack_on_shutdown(client, JACK_ShutdownCallback, 0);
 
-    //unsigned int jack_rate = (unsigned int)jack_get_sample_rate(client);
-    //if(jack_rate != 44100)
-    //    UI.InitMessage(-1, "(warning: this differs from PCM rate, %u)", (unsigned)PCM_RATE);
+    /* The server's rate is fixed; the take is played at it unresampled */
+    if (jack_get_sample_rate(client) != (jack_nframes_t) conf_rate)
+        g_warning("JACK runs at %u Hz, which differs from the sample rate, %d Hz",
+                  (unsigned) jack_get_sample_rate(client), conf_rate);
 
     /* Create one port for mono audio */
     output_port = jack_port_register(client, "out",
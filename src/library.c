@@ -0,0 +1,722 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* The index file is a cache, so it is written in host byte order and
+   simply rebuilt whenever its version, record layout or root differ:
+
+     header  "PSIL", version, record size, entry count, root length, root
+     entry   LibraryRecord followed by path_len bytes of relative path */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "library.h"
+#include "main.h"
+
+#define LIBRARY_MAGIC "PSIL"
+#define LIBRARY_VERSION 2
+/* Fingerprinting saves the index this often, so little work is lost
+   when it is interrupted */
+#define LIBRARY_SAVE_INTERVAL 64
+/* Guards against symlink loops */
+#define LIBRARY_MAX_DEPTH 16
+
+typedef struct _LibraryHeader
+{
+    gchar	magic[4];
+    guint32	version;
+    guint32	record_size;
+    guint32	count;
+    guint32	root_len;
+} LibraryHeader;
+
+typedef struct _LibraryRecord
+{
+    gint64	mtime, size;
+    gdouble	tension, speed, damping, velocity;
+    gint32	type, height, circum, length, plane_length, plane_width;
+    gint32	actuation;
+    gint32	has_fingerprint;
+    PsiFingerprint	fingerprint;
+    guint32	path_len;
+} LibraryRecord;
+
+static void
+entry_set_path (PsiLibraryEntry *entry, gchar *path)
+{
+    entry->path = path;
+    entry->key = g_utf8_casefold(path, -1);
+}
+
+static void
+entries_free (GArray *entries)
+{
+    guint i;
+
+    for (i = 0; i < entries->len; i++) {
+	g_free(g_array_index(entries, PsiLibraryEntry, i).path);
+	g_free(g_array_index(entries, PsiLibraryEntry, i).key);
+    }
+    g_array_free(entries, TRUE);
+}
+
+static gint
+entry_compare (gconstpointer a, gconstpointer b)
+{
+    return strcmp(((const PsiLibraryEntry *) a)->path,
+		  ((const PsiLibraryEntry *) b)->path);
+}
+
+static void
+library_read (PsiLibrary *lib)
+{
+    LibraryHeader	header;
+    LibraryRecord	record;
+    PsiLibraryEntry	entry;
+    gchar		*contents, *p, *end;
+    gsize		length;
+    guint		i;
+
+    if (!g_file_get_contents(lib->index_file, &contents, &length, NULL))
+	return;
+
+    p = contents;
+    end = contents + length;
+    if (length < sizeof(header))
+	goto out;
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    if (memcmp(header.magic, LIBRARY_MAGIC, 4) ||
+	header.version != LIBRARY_VERSION ||
+	header.record_size != sizeof(LibraryRecord) ||
+	header.root_len > (gsize) (end - p) ||
+	strlen(lib->root) != header.root_len ||
+	memcmp(p, lib->root, header.root_len))
+	goto out;
+    p += header.root_len;
+
+    for (i = 0; i < header.count; i++) {
+	if (sizeof(record) > (gsize) (end - p))
+	    break;
+	memcpy(&record, p, sizeof(record));
+	p += sizeof(record);
+	if (record.path_len > (gsize) (end - p) || record.type < 0 ||
+	    record.type >= PRESET_TYPES)
+	    break;
+
+	entry_set_path(&entry, g_strndup(p, record.path_len));
+	p += record.path_len;
+
+	entry.mtime = record.mtime;
+	entry.size = record.size;
+	entry.preset.type = record.type;
+	entry.preset.height = record.height;
+	entry.preset.circum = record.circum;
+	entry.preset.length = record.length;
+	entry.preset.plane_length = record.plane_length;
+	entry.preset.plane_width = record.plane_width;
+	entry.preset.tension = record.tension;
+	entry.preset.speed = record.speed;
+	entry.preset.damping = record.damping;
+	entry.preset.actuation = record.actuation;
+	entry.preset.velocity = record.velocity;
+	entry.has_fingerprint = record.has_fingerprint;
+	entry.fingerprint = record.fingerprint;
+	g_array_append_val(lib->entries, entry);
+    }
+
+out:
+    g_free(contents);
+}
+
+static gboolean
+library_write (PsiLibrary *lib)
+{
+    LibraryHeader	header;
+    LibraryRecord	record;
+    PsiLibraryEntry	*entry;
+    gchar		*tmp_name;
+    FILE		*out;
+    gboolean		ok;
+    guint		i;
+
+    tmp_name = g_strconcat(lib->index_file, ".tmp", NULL);
+    if (!(out = fopen(tmp_name, "wb"))) {
+	g_free(tmp_name);
+	return FALSE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LIBRARY_MAGIC, 4);
+    header.version = LIBRARY_VERSION;
+    header.record_size = sizeof(LibraryRecord);
+    header.count = lib->entries->len;
+    header.root_len = strlen(lib->root);
+    ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+	fwrite(lib->root, 1, header.root_len, out) == header.root_len;
+
+    for (i = 0; ok && i < lib->entries->len; i++) {
+	entry = library_entry(lib, i);
+
+	/* Keeps stack garbage out of the padding */
+	memset(&record, 0, sizeof(record));
+	record.mtime = entry->mtime;
+	record.size = entry->size;
+	record.type = entry->preset.type;
+	record.height = entry->preset.height;
+	record.circum = entry->preset.circum;
+	record.length = entry->preset.length;
+	record.plane_length = entry->preset.plane_length;
+	record.plane_width = entry->preset.plane_width;
+	record.tension = entry->preset.tension;
+	record.speed = entry->preset.speed;
+	record.damping = entry->preset.damping;
+	record.actuation = entry->preset.actuation;
+	record.velocity = entry->preset.velocity;
+	record.has_fingerprint = entry->has_fingerprint;
+	record.fingerprint = entry->fingerprint;
+	record.path_len = strlen(entry->path);
+
+	ok = fwrite(&record, sizeof(record), 1, out) == 1 &&
+	    fwrite(entry->path, 1, record.path_len, out) == record.path_len;
+    }
+
+    if (fclose(out) != 0)
+	ok = FALSE;
+    if (ok)
+	ok = g_rename(tmp_name, lib->index_file) == 0;
+    else
+	g_unlink(tmp_name);
+    g_free(tmp_name);
+
+    return ok;
+}
+
+/* Absolute and without a trailing separator, so that the same folder
+   always maps to the same index */
+static gchar*
+canonical_root (const gchar *root)
+{
+    gchar	*cwd, *path;
+    gsize	len;
+
+    if (g_path_is_absolute(root))
+	path = g_strdup(root);
+    else {
+	cwd = g_get_current_dir();
+	path = g_build_filename(cwd, root, NULL);
+	g_free(cwd);
+    }
+
+    len = strlen(path);
+    while (len > 1 && G_IS_DIR_SEPARATOR(path[len - 1]))
+	path[--len] = '\0';
+
+    return path;
+}
+
+gchar*
+library_index_file (const gchar *root)
+{
+    gchar *canonical, *name, *index_file;
+
+    /* One index per root, so switching folders does not rebuild them */
+    canonical = canonical_root(root);
+    name = g_strdup_printf("library-%08x.idx", g_str_hash(canonical));
+    g_free(canonical);
+    index_file = g_build_filename(g_get_home_dir(), "."PACKAGE, name, NULL);
+    g_free(name);
+
+    return index_file;
+}
+
+PsiLibrary*
+library_open (const gchar *index_file, const gchar *root)
+{
+    PsiLibrary *lib;
+
+    lib = g_new(PsiLibrary, 1);
+    lib->root = canonical_root(root);
+    lib->index_file = g_strdup(index_file);
+    lib->entries = g_array_new(FALSE, FALSE, sizeof(PsiLibraryEntry));
+
+    library_read(lib);
+
+    return lib;
+}
+
+void
+library_free (PsiLibrary *lib)
+{
+    entries_free(lib->entries);
+    g_free(lib->root);
+    g_free(lib->index_file);
+    g_free(lib);
+}
+
+static void
+library_scan (PsiLibrary *lib, const gchar *rel, gint depth,
+	      GHashTable *old, GArray *entries, gint *parsed)
+{
+    PsiLibraryEntry	entry, *prev;
+    GDir		*dir;
+    const gchar		*name;
+    gchar		*dirname, *relname, *fullname;
+    struct stat		st;
+
+    dirname = g_build_filename(lib->root, rel, NULL);
+    dir = g_dir_open(dirname, 0, NULL);
+    g_free(dirname);
+    if (!dir)
+	return;
+
+    while ((name = g_dir_read_name(dir))) {
+	if (name[0] == '.')
+	    continue;
+
+	relname = *rel ? g_build_filename(rel, name, NULL) : g_strdup(name);
+	fullname = g_build_filename(lib->root, relname, NULL);
+
+	if (g_stat(fullname, &st) != 0)
+	    ;
+	else if (S_ISDIR(st.st_mode)) {
+	    if (depth < LIBRARY_MAX_DEPTH)
+		library_scan(lib, relname, depth + 1, old, entries, parsed);
+	} else if (S_ISREG(st.st_mode) && g_str_has_suffix(name, ".psii")) {
+	    prev = g_hash_table_lookup(old, relname);
+	    if (prev && prev->mtime == st.st_mtime && prev->size == st.st_size) {
+		/* Unchanged, the entry moves over with its strings */
+		g_array_append_val(entries, *prev);
+		prev->path = prev->key = NULL;
+	    } else if (preset_load(&entry.preset, fullname)) {
+		entry_set_path(&entry, relname);
+		relname = NULL;
+		entry.mtime = st.st_mtime;
+		entry.size = st.st_size;
+		entry.has_fingerprint = FALSE;
+		g_array_append_val(entries, entry);
+		(*parsed)++;
+	    }
+	}
+
+	g_free(relname);
+	g_free(fullname);
+    }
+
+    g_dir_close(dir);
+}
+
+gint
+library_refresh (PsiLibrary *lib)
+{
+    GHashTable	*old;
+    GArray	*entries;
+    gboolean	changed;
+    gint	parsed = 0;
+    guint	i;
+
+    old = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < lib->entries->len; i++)
+	g_hash_table_insert(old, library_entry(lib, i)->path, library_entry(lib, i));
+
+    entries = g_array_new(FALSE, FALSE, sizeof(PsiLibraryEntry));
+    library_scan(lib, "", 0, old, entries, &parsed);
+    g_hash_table_destroy(old);
+    g_array_sort(entries, entry_compare);
+
+    /* Whatever was not moved over has been removed or replaced */
+    changed = parsed > 0 || !g_file_test(lib->index_file, G_FILE_TEST_EXISTS);
+    for (i = 0; i < lib->entries->len; i++)
+	if (library_entry(lib, i)->path)
+	    changed = TRUE;
+
+    entries_free(lib->entries);
+    lib->entries = entries;
+
+    if (changed && !library_write(lib))
+	return -1;
+
+    return parsed;
+}
+
+void
+library_fingerprint_preset (const PsiPreset *preset, PsiFingerprint *fp)
+{
+    gdouble	*samples;
+    gint	n;
+
+    samples = g_new(gdouble, LIBRARY_FP_RATE * LIBRARY_FP_SECONDS);
+    n = preset_render(preset, LIBRARY_FP_RATE, LIBRARY_FP_RATE * LIBRARY_FP_SECONDS,
+		      samples, 0.0, NULL, NULL, NULL);
+    /* An unstable instrument fingerprints as silence */
+    fingerprint_compute(fp, samples, MAX(n, 0), LIBRARY_FP_RATE);
+    g_free(samples);
+}
+
+gint
+library_fingerprint (PsiLibrary *lib, PsiLibraryProgress *progress, gpointer data)
+{
+    PsiLibraryEntry	*entry;
+    guint		i, total = 0, done = 0;
+
+    for (i = 0; i < lib->entries->len; i++)
+	if (!library_entry(lib, i)->has_fingerprint)
+	    total++;
+
+    for (i = 0; i < lib->entries->len; i++) {
+	entry = library_entry(lib, i);
+	if (entry->has_fingerprint)
+	    continue;
+
+	if (progress)
+	    progress(done, total, entry, data);
+	library_fingerprint_preset(&entry->preset, &entry->fingerprint);
+	entry->has_fingerprint = TRUE;
+
+	if (++done % LIBRARY_SAVE_INTERVAL == 0 && !library_write(lib))
+	    return -1;
+    }
+
+    if (done % LIBRARY_SAVE_INTERVAL != 0 && !library_write(lib))
+	return -1;
+
+    return done;
+}
+
+static gint
+match_compare (gconstpointer a, gconstpointer b)
+{
+    gdouble da = ((const PsiLibraryMatch *) a)->distance;
+    gdouble db = ((const PsiLibraryMatch *) b)->distance;
+
+    return da < db ? -1 : da > db;
+}
+
+GArray*
+library_rank (PsiLibrary *lib, const PsiFingerprint *target)
+{
+    PsiLibraryMatch	match;
+    GArray		*ranked;
+    guint		i;
+
+    ranked = g_array_new(FALSE, FALSE, sizeof(PsiLibraryMatch));
+    for (i = 0; i < lib->entries->len; i++) {
+	if (!library_entry(lib, i)->has_fingerprint)
+	    continue;
+	match.index = i;
+	match.distance = fingerprint_distance(target, &library_entry(lib, i)->fingerprint);
+	g_array_append_val(ranked, match);
+    }
+    g_array_sort(ranked, match_compare);
+
+    return ranked;
+}
+
+typedef enum {
+    FIELD_HEIGHT,
+    FIELD_CIRCUM,
+    FIELD_LENGTH,
+    FIELD_WIDTH,
+    FIELD_TENSION,
+    FIELD_SPEED,
+    FIELD_DAMPING,
+    FIELD_ACTUATION,
+    FIELD_VELOCITY
+} LibraryField;
+
+typedef enum {
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE
+} LibraryOp;
+
+typedef struct _LibraryCond
+{
+    LibraryField	field;
+    LibraryOp		op;
+    gdouble		value;
+} LibraryCond;
+
+struct _PsiLibraryQuery
+{
+    guint	types;	/* bit mask of PsiPresetType, 0 means any */
+    GArray	*conds;	/* of LibraryCond */
+    GPtrArray	*words;	/* casefolded name parts */
+};
+
+static const struct {
+    const gchar		*name;
+    LibraryField	field;
+} fields[] = {
+    { "height", FIELD_HEIGHT },
+    { "circumference", FIELD_CIRCUM },
+    { "circum", FIELD_CIRCUM },
+    { "length", FIELD_LENGTH },
+    { "width", FIELD_WIDTH },
+    { "tension", FIELD_TENSION },
+    { "speed", FIELD_SPEED },
+    { "damping", FIELD_DAMPING },
+    { "damp", FIELD_DAMPING },
+    { "actuation", FIELD_ACTUATION },
+    { "velocity", FIELD_VELOCITY },
+    { NULL }
+};
+
+/* FALSE if the preset has no such parameter, e.g. the width of a tube */
+static gboolean
+preset_field (const PsiPreset *preset, LibraryField field, gdouble *value)
+{
+    switch (field) {
+    case FIELD_HEIGHT:
+	*value = preset->height;
+	return preset->type == PRESET_TUBE;
+    case FIELD_CIRCUM:
+	*value = preset->circum;
+	return preset->type == PRESET_TUBE;
+    case FIELD_LENGTH:
+	*value = preset->type == PRESET_PLANE ? preset->plane_length : preset->length;
+	return preset->type != PRESET_TUBE;
+    case FIELD_WIDTH:
+	*value = preset->plane_width;
+	return preset->type == PRESET_PLANE;
+    case FIELD_TENSION:
+	*value = preset->tension;
+	break;
+    case FIELD_SPEED:
+	*value = preset->speed;
+	break;
+    case FIELD_DAMPING:
+	*value = preset->damping;
+	break;
+    case FIELD_ACTUATION:
+	*value = preset->actuation;
+	break;
+    case FIELD_VELOCITY:
+	*value = preset->velocity;
+	break;
+    }
+
+    return TRUE;
+}
+
+/* "tube" or "tubes" */
+static gboolean
+query_type (const gchar *word, PsiPresetType *type)
+{
+    const gchar	*name;
+    gsize	len;
+
+    for (*type = 0; *type < PRESET_TYPES; (*type)++) {
+	name = preset_type_name(*type);
+	len = strlen(name);
+	if (!g_ascii_strncasecmp(word, name, len) &&
+	    (word[len] == '\0' || !g_ascii_strcasecmp(word + len, "s")))
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gint
+query_field (const gchar *word)
+{
+    gint i;
+
+    for (i = 0; fields[i].name; i++)
+	if (!g_ascii_strcasecmp(word, fields[i].name))
+	    return fields[i].field;
+
+    return -1;
+}
+
+static gboolean
+query_fail (gchar **error, const gchar *format, const gchar *what)
+{
+    if (error)
+	*error = g_strdup_printf(format, what);
+
+    return FALSE;
+}
+
+static gboolean
+query_parse (PsiLibraryQuery *query, const gchar *text, gchar **error)
+{
+    LibraryCond		cond;
+    PsiPresetType	type;
+    const gchar		*p = text, *start;
+    gchar		*word, *end;
+    gint		field = -1;
+
+    while (*p) {
+	if (g_ascii_isspace(*p) || *p == ',') {
+	    p++;
+	    continue;
+	}
+
+	if (strchr("<>=!", *p)) {
+	    start = p;
+	    switch (*p++) {
+	    case '<':
+		cond.op = OP_LT;
+		break;
+	    case '>':
+		cond.op = OP_GT;
+		break;
+	    case '=':
+		cond.op = OP_EQ;
+		break;
+	    case '!':
+		cond.op = OP_NE;
+		if (*p != '=')
+		    return query_fail(error, _("Unknown operator at \"%s\""), start);
+		break;
+	    }
+	    if (*p == '=') {
+		p++;
+		if (cond.op == OP_LT)
+		    cond.op = OP_LE;
+		else if (cond.op == OP_GT)
+		    cond.op = OP_GE;
+	    }
+
+	    if (field < 0)
+		return query_fail(error, _("No parameter before \"%s\""), start);
+
+	    while (g_ascii_isspace(*p))
+		p++;
+	    cond.value = g_ascii_strtod(p, &end);
+	    if (end == p)
+		return query_fail(error, _("Number expected after \"%s\""), start);
+	    p = end;
+
+	    cond.field = field;
+	    g_array_append_val(query->conds, cond);
+	    field = -1;
+	    continue;
+	}
+
+	if (field >= 0)
+	    return query_fail(error, _("Comparison expected at \"%s\""), p);
+
+	start = p;
+	while (*p && !g_ascii_isspace(*p) && *p != ',' && !strchr("<>=!", *p))
+	    p++;
+	word = g_strndup(start, p - start);
+
+	if (!g_ascii_strcasecmp(word, "and") || !g_ascii_strcasecmp(word, "with"))
+	    ;
+	else if (query_type(word, &type))
+	    query->types |= 1 << type;
+	else if ((field = query_field(word)) >= 0)
+	    ;
+	else
+	    g_ptr_array_add(query->words, g_utf8_casefold(word, -1));
+
+	g_free(word);
+    }
+
+    if (field >= 0)
+	return query_fail(error, "%s", _("Comparison expected at the end"));
+
+    return TRUE;
+}
+
+PsiLibraryQuery*
+library_query_new (const gchar *text, gchar **error)
+{
+    PsiLibraryQuery *query;
+
+    query = g_new(PsiLibraryQuery, 1);
+    query->types = 0;
+    query->conds = g_array_new(FALSE, FALSE, sizeof(LibraryCond));
+    query->words = g_ptr_array_new();
+
+    if (!query_parse(query, text, error)) {
+	library_query_free(query);
+	return NULL;
+    }
+
+    return query;
+}
+
+void
+library_query_free (PsiLibraryQuery *query)
+{
+    g_array_free(query->conds, TRUE);
+    g_ptr_array_foreach(query->words, (GFunc) g_free, NULL);
+    g_ptr_array_free(query->words, TRUE);
+    g_free(query);
+}
+
+gboolean
+library_query_match (const PsiLibraryQuery *query, const PsiLibraryEntry *entry)
+{
+    const LibraryCond	*cond;
+    gdouble		value;
+    gboolean		ok = FALSE;
+    guint		i;
+
+    if (query->types && !(query->types & (1 << entry->preset.type)))
+	return FALSE;
+
+    for (i = 0; i < query->conds->len; i++) {
+	cond = &g_array_index(query->conds, LibraryCond, i);
+	if (!preset_field(&entry->preset, cond->field, &value))
+	    return FALSE;
+
+	switch (cond->op) {
+	case OP_LT:
+	    ok = value < cond->value;
+	    break;
+	case OP_LE:
+	    ok = value <= cond->value;
+	    break;
+	case OP_GT:
+	    ok = value > cond->value;
+	    break;
+	case OP_GE:
+	    ok = value >= cond->value;
+	    break;
+	/* Instruments store doubles with six decimals */
+	case OP_EQ:
+	    ok = fabs(value - cond->value) < 5e-7;
+	    break;
+	case OP_NE:
+	    ok = fabs(value - cond->value) >= 5e-7;
+	    break;
+	}
+	if (!ok)
+	    return FALSE;
+    }
+
+    for (i = 0; i < query->words->len; i++)
+	if (!strstr(entry->key, g_ptr_array_index(query->words, i)))
+	    return FALSE;
+
+    return TRUE;
+}
@@ -0,0 +1,105 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_LIBRARY
+#define _PSI_LIBRARY
+
+#include <glib.h>
+
+#include "preset.h"
+#include "fingerprint.h"
+
+/* Preset library: every instrument file below a root directory, with its
+   parameters cached in a binary index file so the library can be browsed
+   and searched without parsing the instruments again. */
+
+typedef struct _PsiLibraryEntry
+{
+    gchar	*path;	/* relative to the library root */
+    gchar	*key;	/* casefolded path, for name searches */
+    gint64	mtime;
+    gint64	size;
+    PsiPreset	preset;
+    gboolean	has_fingerprint;
+    PsiFingerprint	fingerprint;
+} PsiLibraryEntry;
+
+typedef struct _PsiLibrary
+{
+    gchar	*root;
+    gchar	*index_file;
+    GArray	*entries;	/* of PsiLibraryEntry, sorted by path */
+} PsiLibrary;
+
+/* Index file in the configuration directory for the library at root */
+gchar*		library_index_file	(const gchar *root);
+
+/* Reads the index if it exists and was built for the same root;
+   call library_refresh() to bring it up to date */
+PsiLibrary*	library_open		(const gchar *index_file, const gchar *root);
+void		library_free		(PsiLibrary *lib);
+/* Rescans the root, parsing only new or modified files, and rewrites the
+   index if anything changed.  Returns the number of files parsed, or -1
+   if the index could not be written. */
+gint		library_refresh		(PsiLibrary *lib);
+
+#define library_entry(lib, i) (&g_array_index((lib)->entries, PsiLibraryEntry, (i)))
+
+/* Fingerprints are taken from this much of a normalized render */
+#define LIBRARY_FP_RATE 44100
+#define LIBRARY_FP_SECONDS 2
+
+typedef void PsiLibraryProgress (guint done, guint total,
+				 const PsiLibraryEntry *entry, gpointer data);
+
+void		library_fingerprint_preset	(const PsiPreset *preset,
+						 PsiFingerprint *fp);
+/* Renders and fingerprints every entry which has none yet, calling
+   progress (if not NULL) before each one.  Returns the number of new
+   fingerprints, or -1 if the index could not be written. */
+gint		library_fingerprint	(PsiLibrary *lib, PsiLibraryProgress *progress,
+					 gpointer data);
+
+typedef struct _PsiLibraryMatch
+{
+    guint	index;
+    gdouble	distance;
+} PsiLibraryMatch;
+
+/* The fingerprinted entries as PsiLibraryMatch, nearest first; a linear
+   scan, which takes well under a millisecond for thousands of entries */
+GArray*		library_rank		(PsiLibrary *lib, const PsiFingerprint *target);
+
+/* Queries are whitespace separated terms which must all hold:
+     tube, rods, ...	preset type (several types are alternatives)
+     height > 20	comparison of height, circumference, length, width,
+			tension, speed, damping, actuation or velocity
+			using <, <=, >, >=, = or !=
+     anything else	part of the file name
+   "and" and "with" are ignored, so "tubes with height > 20 and
+   damping < 0.02" works as expected. */
+typedef struct _PsiLibraryQuery PsiLibraryQuery;
+
+/* Returns NULL and sets *error (if error is not NULL) on bad input */
+PsiLibraryQuery*	library_query_new	(const gchar *text, gchar **error);
+void			library_query_free	(PsiLibraryQuery *query);
+gboolean		library_query_match	(const PsiLibraryQuery *query,
+						 const PsiLibraryEntry *entry);
+
+#endif
@@ -33,6 +33,13 @@
 #include "interface.h"
 #include "main.h"
 #include "xml-parser.h"
+#include "player.h"
+#include "similar.h"
+#include "fit.h"
+#include "sampler.h"
+#include "bench.h"
+#include "golden.h"
+#include "trace.h"
 
 #ifdef DRIVER_ALSA
 #include "alsa.h"
@@ -46,7 +53,11 @@
 #include "jack.h"
 #endif
 
+#include "null.h"
+#include "wavsink.h"
+
 static guint current_driver;
+static gboolean driver_pending = FALSE;
 
 GSList *driver_list = NULL;
 
@@ -55,12 +66,12 @@ inline guint psi_get_current_driver(void)
     return current_driver;
 }
 
-void psi_driver_errmessage(int errno)
+void psi_driver_errmessage(drv *d, int errnum)
 {
     static const char *message = N_("Sound driver error:\n");
     char *buffer, *drv_message;
 
-    drv_message = (char*)_(driver->err(errno));
+    drv_message = (char*)_(d->err(errnum));
     buffer = malloc(strlen(message) + strlen(drv_message) + 1);
 
     strcpy(buffer, message);
@@ -71,20 +82,33 @@ void psi_driver_errmessage(int errno)
     free(buffer);
 }
 
+/* Called on the GUI thread once the playback thread has tried to open d,
+   or when a write to it failed */
+void psi_driver_report(drv *d, int errnum)
+{
+    gchar *msg;
+
+    if (d != g_slist_nth_data(driver_list, current_driver))
+	return; /* superseded by another choice in the meantime */
+
+    driver_pending = FALSE;
+    if (errnum < 0) {
+	gui_set_status(_("No sound output"));
+	psi_driver_errmessage(d, errnum);
+    } else {
+	msg = g_strdup_printf(_("%s ready"), _(d->description));
+	gui_set_status(msg);
+	g_free(msg);
+    }
+}
+
+/* The driver is opened in the background, see player.c */
 void psi_set_driver(guint drv)
 {
-    int err;
-    if (driver)
-        driver->close();
-    driver = g_slist_nth_data(driver_list, drv);
     current_driver = drv;
-    if (driver != NULL)
-    {
-        if ((err = driver->open()) < 0) {
-            psi_driver_errmessage(err);
-            driver = NULL;
-        }
-    }
+    driver_pending = g_slist_nth_data(driver_list, drv) != NULL;
+    gui_set_status(driver_pending ? _("Opening sound output...") : _("No sound output"));
+    player_set_driver(g_slist_nth_data(driver_list, drv));
 }
 
 int main(int argc, char *argv[])
@@ -94,6 +118,7 @@ int main(int argc, char *argv[])
     struct stat		st;
     struct passwd	*pw;
     gchar		*confdir, *conffile, *current_driver_string;
+    gchar		*export_format_string;
     xmlpContext		*cfg;
 
 #ifdef ENABLE_NLS
@@ -103,6 +128,20 @@ int main(int argc, char *argv[])
     textdomain(PACKAGE);
 #endif
 
+    trace_open();
+
+    /* Command line tools, which need no display */
+    if(argc > 1 && !strcmp(argv[1], "--similar"))
+	return similar_main(argc - 1, argv + 1);
+    if(argc > 1 && !strcmp(argv[1], "--fit"))
+	return fit_main(argc - 1, argv + 1);
+    if(argc > 1 && !strcmp(argv[1], "--sampler"))
+	return sampler_main(argc - 1, argv + 1);
+    if(argc > 1 && !strcmp(argv[1], "--integrators"))
+	return bench_main(argc - 1, argv + 1);
+    if(argc > 1 && !strcmp(argv[1], "--golden"))
+	return golden_main(argc - 1, argv + 1);
+
     gtk_init(&argc, &argv);
 #ifdef HAVE_OPENGL
     gtk_gl_init (&argc, &argv);
@@ -117,6 +156,9 @@ int main(int argc, char *argv[])
 #ifdef DRIVER_ALSA
     driver_list = g_slist_append(driver_list, &driver_alsa);
 #endif
+    driver_list = g_slist_append(driver_list, &driver_null);
+    driver_list = g_slist_append(driver_list, &driver_null_unpaced);
+    driver_list = g_slist_append(driver_list, &driver_wavsink);
 
     pw = getpwuid(getuid());
     confdir = g_strconcat(pw->pw_dir, "/."PACKAGE, NULL);
@@ -141,15 +183,30 @@ int main(int argc, char *argv[])
 	}
 	xmlp_free_string(current_driver_string);
     }
+    /* The drivers open at this rate, so it has to be known first */
+    conf_rate = xmlp_get_int_default(cfg, "behaviour/", "rate", 44100);
+    if (conf_rate < 8000 || conf_rate > 192000)
+	conf_rate = 44100;
+    conf_reduced_rate = xmlp_get_boolean_default(cfg, "behaviour/", "reduced_rate", FALSE);
+    player_init();
     psi_set_driver(current_driver);
     
     conf_autoext = xmlp_get_boolean_default(cfg, "behaviour/", "auto_ext", TRUE);
     conf_overwrite_warning = xmlp_get_boolean_default(cfg, "behaviour/", "overwrite_warning", TRUE);
+    conf_play_overlap = xmlp_get_boolean_default(cfg, "behaviour/", "play_overlap", FALSE);
+    conf_render_log = xmlp_get_boolean_default(cfg, "behaviour/", "render_log", FALSE);
+    conf_dither = xmlp_get_boolean_default(cfg, "behaviour/", "dither", FALSE);
+    if((export_format_string = xmlp_get_string(cfg, "behaviour/", "export_format"))) {
+	conf_export_format = export_format_lookup(export_format_string);
+	xmlp_free_string(export_format_string);
+    }
     conf_instr_path = xmlp_get_string(cfg, "paths/", "instr_path");
     conf_sample_path = xmlp_get_string(cfg, "paths/", "sample_path");
 
     AppWindow = gui_create_AppWindow();
     gtk_widget_show(AppWindow);
+    if (driver_pending)
+	gui_set_status(_("Opening sound output..."));
 
     gtk_main();
 
@@ -158,6 +215,13 @@ int main(int argc, char *argv[])
         xmlp_set_string(cfg, "driver/", "current", (gchar *)currd->description);
     xmlp_set_boolean(cfg, "behaviour/", "auto_ext", conf_autoext);
     xmlp_set_boolean(cfg, "behaviour/", "overwrite_warning", conf_overwrite_warning);
+    xmlp_set_boolean(cfg, "behaviour/", "play_overlap", conf_play_overlap);
+    xmlp_set_boolean(cfg, "behaviour/", "render_log", conf_render_log);
+    xmlp_set_boolean(cfg, "behaviour/", "dither", conf_dither);
+    xmlp_set_int(cfg, "behaviour/", "rate", conf_rate);
+    xmlp_set_boolean(cfg, "behaviour/", "reduced_rate", conf_reduced_rate);
+    xmlp_set_string(cfg, "behaviour/", "export_format",
+		    (gchar *)export_format_name(conf_export_format));
     if(conf_instr_path) {
 	xmlp_set_string(cfg, "paths/", "instr_path", conf_instr_path);
 	xmlp_free_string(conf_instr_path);
@@ -168,8 +232,7 @@ int main(int argc, char *argv[])
     }
     xmlp_sync(cfg);
 
-    if (driver)
-        driver->close();
+    player_shutdown();
 
     return 0;
 }
@@ -22,6 +22,8 @@
 
 #include <glib.h>
 
+#include "export.h"
+
 #ifndef _
 #if defined(ENABLE_NLS)
 #  include <libintl.h>
@@ -47,14 +49,16 @@ typedef struct _drv
     const char* (*err)(int);
 } drv;
 
-drv		*driver;
-
 /* global configuration variables */
-gboolean	conf_autoext, conf_overwrite_warning;
+gboolean	conf_autoext, conf_overwrite_warning, conf_play_overlap, conf_render_log,
+		conf_dither, conf_reduced_rate;
+gint		conf_rate;
 gchar		*conf_instr_path, *conf_sample_path;
+PsiExportFormat	conf_export_format;
 
 inline guint				psi_get_current_driver	(void);
 void					psi_set_driver		(guint driver);
-void                                    psi_driver_errmessage   (int errno);
+void                                    psi_driver_errmessage   (drv *d, int errnum);
+void                                    psi_driver_report       (drv *d, int errnum);
 
 #endif
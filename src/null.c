@@ -0,0 +1,143 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2003 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Output drivers which throw the samples away.  The paced variant behaves
+   like a sound card with a 2 * 2048 frame buffer running at the stream rate,
+   so the playback path can be timed without any hardware; the unpaced one
+   consumes everything as fast as it is offered.  Statistics are printed to
+   stderr when the driver is closed. */
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "null.h"
+
+/* Simulated device buffer, the same as the ALSA driver asks for */
+#define NULL_BUFFER_FRAMES (2 * 2048)
+
+static unsigned int rate;
+
+static gboolean paced;
+static GTimer *timer = NULL;
+
+/* Stream time (in seconds) up to which the device has been fed */
+static gdouble fed;
+static gulong frames, calls, underruns;
+static gdouble max_late, max_interval, last_call;
+
+static int null_start(gboolean pace)
+{
+    paced = pace;
+    rate = conf_rate;
+    if (timer == NULL)
+	timer = g_timer_new();
+    g_timer_start(timer);
+
+    fed = 0.0;
+    frames = calls = underruns = 0;
+    max_late = max_interval = last_call = 0.0;
+
+    return 0;
+}
+
+static int null_open(void)
+{
+    return null_start(TRUE);
+}
+
+static int null_open_unpaced(void)
+{
+    return null_start(FALSE);
+}
+
+static int null_play(gint16 * ptr, int n)
+{
+    gdouble now, ahead;
+
+    now = g_timer_elapsed(timer, NULL);
+    if (calls > 0 && now - last_call > max_interval)
+	max_interval = now - last_call;
+
+    if (paced) {
+	ahead = fed - now;
+	if (ahead < 0.0) {
+	    /* The device would have run dry before this write arrived */
+	    if (frames > 0) {
+		underruns++;
+		if (-ahead > max_late)
+		    max_late = -ahead;
+	    }
+	    fed = now;
+	} else if (ahead > (gdouble) NULL_BUFFER_FRAMES / rate) {
+	    /* Block until there is room for the new frames */
+	    g_usleep((gulong) ((ahead - (gdouble) NULL_BUFFER_FRAMES / rate) * G_USEC_PER_SEC));
+	}
+	fed += (gdouble) n / rate;
+    }
+
+    frames += n;
+    calls++;
+    last_call = g_timer_elapsed(timer, NULL);
+
+    return n;
+}
+
+static void null_close(void)
+{
+    gdouble elapsed;
+
+    if (timer == NULL)
+	return;
+
+    elapsed = g_timer_elapsed(timer, NULL);
+    if (calls > 0)
+	fprintf(stderr, "null output: %lu frames in %lu writes, %.3f s wall clock "
+		"(%.1fx real time), max write interval %.3f ms, "
+		"%lu underruns, max lateness %.3f ms\n",
+		frames, calls, elapsed,
+		elapsed > 0.0 ? (gdouble) frames / rate / elapsed : 0.0,
+		max_interval * 1000.0, underruns, max_late * 1000.0);
+
+    g_timer_destroy(timer);
+    timer = NULL;
+}
+
+static const char *null_err(int errnum)
+{
+    static const char *message =
+	N_("Sorry, no diagnostics is available in null driver");
+
+    return message;
+}
+
+drv driver_null = {
+    N_("Null output"),
+    null_open,
+    null_play,
+    null_close,
+    null_err
+};
+
+drv driver_null_unpaced = {
+    N_("Null output (unpaced)"),
+    null_open_unpaced,
+    null_play,
+    null_close,
+    null_err
+};
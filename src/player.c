@@ -0,0 +1,378 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2003 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Background playback.  The GUI thread only ever pushes commands into a
+   single-producer/single-consumer ring; a dedicated thread pops them, mixes
+   the active voices and feeds the current driver in blocks of 2048 frames.
+   The driver is owned by that thread too: it is opened there on request,
+   so a slow or absent sound server never holds up the GUI, and the outcome
+   is reported back through the main loop.  The mutex/cond pair is used
+   solely to put the thread to sleep while there is nothing to do. */
+
+#include <string.h>
+#include <glib.h>
+
+#include "player.h"
+#include "convert.h"
+#include "trace.h"
+#include "main.h"
+
+/* Frames per driver write, the most any driver accepts at once */
+#define PLAYER_BLOCK 2048
+/* Must be a power of two */
+#define PLAYER_QUEUE_SIZE 16
+#define PLAYER_VOICES 8
+
+typedef enum {
+    PLAYER_CMD_PLAY,
+    PLAYER_CMD_STOP,
+    PLAYER_CMD_OPEN,
+    PLAYER_CMD_QUIT
+} PlayerCmdType;
+
+typedef struct _PlayerBuffer
+{
+    gint	length;
+    gint16	data[1];
+} PlayerBuffer;
+
+typedef struct _PlayerCmd
+{
+    PlayerCmdType	type;
+    gboolean		overlap;
+    PlayerBuffer	*buffer;
+    drv			*driver;
+} PlayerCmd;
+
+typedef struct _PlayerVoice
+{
+    PlayerBuffer	*buffer;
+    gint		pos;
+} PlayerVoice;
+
+static PlayerCmd queue[PLAYER_QUEUE_SIZE];
+static volatile gint queue_head = 0;	/* written by the GUI thread only */
+static volatile gint queue_tail = 0;	/* written by the playback thread only */
+
+static GMutex wakeup_mutex;
+static GCond wakeup_cond;
+static GThread *thread = NULL;
+
+/* Only touched by the playback thread */
+static drv *driver = NULL;
+
+static PlayerVoice voices[PLAYER_VOICES];
+
+static gboolean queue_push(PlayerCmd *cmd)
+{
+    gint head, next;
+
+    head = g_atomic_int_get(&queue_head);
+    next = (head + 1) & (PLAYER_QUEUE_SIZE - 1);
+    if (next == g_atomic_int_get(&queue_tail))
+	return FALSE;
+
+    queue[head] = *cmd;
+    g_atomic_int_set(&queue_head, next);
+
+    g_mutex_lock(&wakeup_mutex);
+    g_cond_signal(&wakeup_cond);
+    g_mutex_unlock(&wakeup_mutex);
+
+    return TRUE;
+}
+
+static gboolean queue_pop(PlayerCmd *cmd)
+{
+    gint tail;
+
+    tail = g_atomic_int_get(&queue_tail);
+    if (tail == g_atomic_int_get(&queue_head))
+	return FALSE;
+
+    *cmd = queue[tail];
+    g_atomic_int_set(&queue_tail, (tail + 1) & (PLAYER_QUEUE_SIZE - 1));
+
+    return TRUE;
+}
+
+static void voices_stop(void)
+{
+    gint i;
+
+    for (i = 0; i < PLAYER_VOICES; i++) {
+	g_free(voices[i].buffer);
+	voices[i].buffer = NULL;
+    }
+}
+
+static gboolean voices_active(void)
+{
+    gint i;
+
+    for (i = 0; i < PLAYER_VOICES; i++)
+	if (voices[i].buffer)
+	    return TRUE;
+
+    return FALSE;
+}
+
+static void voices_start(PlayerBuffer *buffer, gboolean overlap)
+{
+    gint i, oldest = 0;
+
+    if (!overlap)
+	voices_stop();
+
+    for (i = 0; i < PLAYER_VOICES; i++) {
+	if (voices[i].buffer == NULL)
+	    break;
+	if (voices[i].pos > voices[oldest].pos)
+	    oldest = i;
+    }
+
+    /* All voices busy: steal the one which has played the longest */
+    if (i == PLAYER_VOICES) {
+	i = oldest;
+	g_free(voices[i].buffer);
+    }
+
+    voices[i].buffer = buffer;
+    voices[i].pos = 0;
+}
+
+/* Returns number of mixed frames, 0 when everything has finished */
+static gint voices_mix(gint16 *out)
+{
+    gint32 mix[PLAYER_BLOCK];
+    gint i, j, n, frames = 0;
+
+    memset(mix, 0, sizeof(mix));
+
+    for (i = 0; i < PLAYER_VOICES; i++) {
+	PlayerVoice *v = &voices[i];
+
+	if (v->buffer == NULL)
+	    continue;
+
+	n = MIN(PLAYER_BLOCK, v->buffer->length - v->pos);
+	for (j = 0; j < n; j++)
+	    mix[j] += v->buffer->data[v->pos + j];
+	v->pos += n;
+	frames = MAX(frames, n);
+
+	if (v->pos >= v->buffer->length) {
+	    g_free(v->buffer);
+	    v->buffer = NULL;
+	}
+    }
+
+    for (j = 0; j < frames; j++)
+	out[j] = CLAMP(mix[j], -32768, 32767);
+
+    return frames;
+}
+
+typedef struct _PlayerReport
+{
+    drv		*driver;
+    gint	err;
+} PlayerReport;
+
+static gboolean report_driver(gpointer data)
+{
+    PlayerReport *report = data;
+
+    psi_driver_report(report->driver, report->err);
+    g_free(report);
+
+    return FALSE;
+}
+
+static void player_report(drv *d, gint err)
+{
+    PlayerReport *report;
+
+    report = g_new(PlayerReport, 1);
+    report->driver = d;
+    report->err = err;
+    g_idle_add(report_driver, report);
+}
+
+static void player_open(drv *d)
+{
+    gint err;
+
+    if (driver)
+	driver->close();
+    driver = NULL;
+
+    if (d == NULL)
+	return;
+
+    if ((err = d->open()) < 0) {
+	player_report(d, err);
+	return;
+    }
+
+    driver = d;
+    player_report(d, 0);
+}
+
+static gint player_write(gint16 *ptr, gint frames)
+{
+    gint n = 0;
+    gint64 start = trace_begin();
+
+    while (frames > 0 && driver != NULL) {
+	n = driver->play(ptr, frames);
+	if (n < 0)
+	    break;
+	ptr += n;
+	frames -= n;
+    }
+    trace_end("driver write", start);
+
+    return n;
+}
+
+static gpointer player_thread(gpointer data)
+{
+    PlayerCmd cmd;
+    gint16 block[PLAYER_BLOCK];
+    gint frames, err;
+
+    trace_thread_name("player");
+
+    for (;;) {
+	while (queue_pop(&cmd)) {
+	    switch (cmd.type) {
+	    case PLAYER_CMD_PLAY:
+		if (driver)
+		    voices_start(cmd.buffer, cmd.overlap);
+		else
+		    g_free(cmd.buffer);
+		break;
+	    case PLAYER_CMD_STOP:
+		voices_stop();
+		break;
+	    case PLAYER_CMD_OPEN:
+		player_open(cmd.driver);
+		break;
+	    case PLAYER_CMD_QUIT:
+		voices_stop();
+		player_open(NULL);
+		return NULL;
+	    }
+	}
+
+	if (!voices_active()) {
+	    g_mutex_lock(&wakeup_mutex);
+	    while (g_atomic_int_get(&queue_tail) == g_atomic_int_get(&queue_head))
+		g_cond_wait(&wakeup_cond, &wakeup_mutex);
+	    g_mutex_unlock(&wakeup_mutex);
+	    continue;
+	}
+
+	frames = voices_mix(block);
+	if (frames > 0 && (err = player_write(block, frames)) < 0) {
+	    voices_stop();
+	    player_report(driver, err);
+	}
+    }
+
+    return NULL;
+}
+
+void player_init(void)
+{
+    g_mutex_init(&wakeup_mutex);
+    g_cond_init(&wakeup_cond);
+
+    thread = g_thread_new("player", player_thread, NULL);
+}
+
+void player_shutdown(void)
+{
+    PlayerCmd cmd;
+
+    if (thread == NULL)
+	return;
+
+    cmd.type = PLAYER_CMD_QUIT;
+    cmd.buffer = NULL;
+    /* The thread drains the queue continuously, so this can't spin long */
+    while (!queue_push(&cmd))
+	g_usleep(1000);
+
+    g_thread_join(thread);
+    thread = NULL;
+}
+
+gboolean player_play(const gfloat *samples, gint n, gdouble gain,
+		     gboolean dither, gboolean overlap)
+{
+    PlayerCmd cmd;
+    PsiDither state;
+
+    if (thread == NULL || samples == NULL || n <= 0)
+	return FALSE;
+
+    cmd.type = PLAYER_CMD_PLAY;
+    cmd.overlap = overlap;
+    cmd.buffer = g_malloc(sizeof(PlayerBuffer) + sizeof(gint16) * (n - 1));
+    cmd.buffer->length = n;
+    convert_dither_init(&state);
+    convert_float_samples(samples, n, gain, CONVERT_S16, cmd.buffer->data,
+			  dither ? &state : NULL);
+
+    if (!queue_push(&cmd)) {
+	g_free(cmd.buffer);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean player_set_driver(drv *d)
+{
+    PlayerCmd cmd;
+
+    if (thread == NULL)
+	return FALSE;
+
+    cmd.type = PLAYER_CMD_OPEN;
+    cmd.buffer = NULL;
+    cmd.driver = d;
+
+    return queue_push(&cmd);
+}
+
+gboolean player_stop(void)
+{
+    PlayerCmd cmd;
+
+    if (thread == NULL)
+	return FALSE;
+
+    cmd.type = PLAYER_CMD_STOP;
+    cmd.buffer = NULL;
+
+    return queue_push(&cmd);
+}
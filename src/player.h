@@ -0,0 +1,40 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2003 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_PLAYER
+#define _PSI_PLAYER
+
+#include <glib.h>
+
+#include "main.h"
+
+void		player_init		(void);
+void		player_shutdown		(void);
+
+/* Both return immediately; FALSE means the command queue is full.
+   samples are the raw take, converted to 16 bits with gain on the way
+   into the player's own buffer. */
+gboolean	player_play		(const gfloat *samples, gint n, gdouble gain,
+					 gboolean dither, gboolean overlap);
+gboolean	player_stop		(void);
+/* Closes the current driver and opens d (if not NULL) in the background;
+   the result arrives in psi_driver_report() on the GUI thread */
+gboolean	player_set_driver	(drv *d);
+
+#endif
@@ -0,0 +1,178 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <glib.h>
+
+#include "preset.h"
+#include "xml-parser.h"
+
+static const gchar *types[PRESET_TYPES] = {"tube", "rod", "plane"};
+
+void
+preset_init (PsiPreset *preset)
+{
+    preset->type = PRESET_TUBE;
+    preset->height = 10;
+    preset->circum = 5;
+    preset->length = 5;
+    preset->plane_length = 7;
+    preset->plane_width = 9;
+    preset->tension = 4.0;
+    preset->speed = 0.2;
+    preset->damping = 0.05;
+    preset->actuation = 0;
+    preset->velocity = 1.0;
+}
+
+const gchar*
+preset_type_name (PsiPresetType type)
+{
+    return types[type];
+}
+
+PsiPresetType
+preset_type_lookup (const gchar *name)
+{
+    PsiPresetType type;
+
+    for(type = 0; type < PRESET_TYPES; type++)
+	if(!g_ascii_strcasecmp(name, types[type]))
+	    return type;
+
+    return PRESET_TUBE;
+}
+
+gboolean
+preset_load (PsiPreset *preset, const gchar *fname)
+{
+    xmlpContext	*instr;
+    gchar	*type;
+
+    preset_init(preset);
+
+    if(!(instr = xmlp_get_doc(fname, "psiinstr")))
+	return FALSE;
+
+    type = xmlp_get_string_default(instr, "", "type", "tube");
+    preset->type = preset_type_lookup(type);
+    xmlp_free_string(type);
+
+    switch(preset->type) {
+    case PRESET_TUBE:
+	preset->height = xmlp_get_int_default(instr, "", "height", preset->height);
+	preset->circum = xmlp_get_int_default(instr, "", "circumference", preset->circum);
+	break;
+    case PRESET_ROD:
+	preset->length = xmlp_get_int_default(instr, "", "length", preset->length);
+	break;
+    case PRESET_PLANE:
+	preset->plane_length = xmlp_get_int_default(instr, "", "length", preset->plane_length);
+	preset->plane_width = xmlp_get_int_default(instr, "", "width", preset->plane_width);
+	break;
+    default:
+	break;
+    }
+
+    preset->tension = xmlp_get_double_default(instr, "", "tension", preset->tension);
+    preset->speed = xmlp_get_double_default(instr, "", "speed", preset->speed);
+    preset->damping = xmlp_get_double_default(instr, "", "damping", preset->damping);
+    preset->actuation = xmlp_get_int_default(instr, "", "actuation", preset->actuation);
+    preset->velocity = xmlp_get_double_default(instr, "", "velocity", preset->velocity);
+
+    xmlp_free(instr);
+    return TRUE;
+}
+
+void
+preset_save (const PsiPreset *preset, const gchar *fname)
+{
+    xmlpContext	*instr;
+
+    instr = xmlp_new_doc(fname, "psiinstr");
+
+    xmlp_set_string(instr, "", "type", types[preset->type]);
+
+    switch(preset->type) {
+    case PRESET_TUBE:
+	xmlp_set_int(instr, "", "height", preset->height);
+	xmlp_set_int(instr, "", "circumference", preset->circum);
+	break;
+    case PRESET_ROD:
+	xmlp_set_int(instr, "", "length", preset->length);
+	break;
+    case PRESET_PLANE:
+	xmlp_set_int(instr, "", "length", preset->plane_length);
+	xmlp_set_int(instr, "", "width", preset->plane_width);
+	break;
+    default:
+	break;
+    }
+
+    xmlp_set_double(instr, "", "tension", preset->tension);
+    xmlp_set_double(instr, "", "speed", preset->speed);
+    xmlp_set_double(instr, "", "damping", preset->damping);
+    xmlp_set_int(instr, "", "actuation", preset->actuation);
+    xmlp_set_double(instr, "", "velocity", preset->velocity);
+
+    xmlp_sync(instr);
+    xmlp_free(instr);
+}
+
+gint
+preset_render (const PsiPreset *preset, gint rate, gint len, gdouble *samples,
+	       gdouble att, PSPercentCallback *cb, gpointer userdata,
+	       PSRenderOptions *opts)
+{
+    switch(preset->type) {
+    case PRESET_ROD:
+	return ps_metal_obj_render_rod(rate, preset->length, preset->tension,
+				       preset->speed, preset->damping,
+				       preset->actuation, preset->velocity, len,
+				       samples, cb, att, userdata, opts);
+    case PRESET_PLANE:
+	return ps_metal_obj_render_plane(rate, preset->plane_length,
+					 preset->plane_width, preset->tension,
+					 preset->speed, preset->damping,
+					 preset->actuation, preset->velocity, len,
+					 samples, cb, att, userdata, opts);
+    case PRESET_TUBE:
+    default:
+	return ps_metal_obj_render_tube(rate, preset->height, preset->circum,
+					preset->tension, preset->speed,
+					preset->damping, preset->actuation,
+					preset->velocity, len, samples, cb, att,
+					userdata, opts);
+    }
+}
+
+PSMetalTopology*
+preset_topology (const PsiPreset *preset)
+{
+    switch(preset->type) {
+    case PRESET_ROD:
+	return ps_metal_topology_new_rod(preset->length, preset->tension);
+    case PRESET_PLANE:
+	return ps_metal_topology_new_plane(preset->plane_length,
+					   preset->plane_width, preset->tension);
+    case PRESET_TUBE:
+    default:
+	return ps_metal_topology_new_tube(preset->height, preset->circum,
+					  preset->tension);
+    }
+}
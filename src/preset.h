@@ -0,0 +1,80 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_PRESET
+#define _PSI_PRESET
+
+#include <glib.h>
+
+#include "api-wrapper.h"
+
+typedef enum {
+    PRESET_TUBE,
+    PRESET_ROD,
+    PRESET_PLANE,
+    PRESET_TYPES
+} PsiPresetType;
+
+/* Parameter ranges offered by the interface */
+#define PRESET_SIZE_MIN		3
+#define PRESET_TUBE_MAX		30	/* both height and circumference */
+#define PRESET_ROD_MAX		200
+#define PRESET_PLANE_LENGTH_MAX	30
+#define PRESET_PLANE_WIDTH_MAX	39
+#define PRESET_TENSION_MIN	0.1
+#define PRESET_TENSION_MAX	16.0
+#define PRESET_SPEED_MIN	0.0
+#define PRESET_SPEED_MAX	0.5
+#define PRESET_DAMPING_MIN	0.005
+#define PRESET_DAMPING_MAX	0.5
+
+/* Everything an instrument (.psii) file describes.  Only the dimensions
+   of the preset's own type are meaningful, the others keep defaults. */
+typedef struct _PsiPreset
+{
+    PsiPresetType	type;
+    gint		height, circum;			/* tube */
+    gint		length;				/* rod */
+    gint		plane_length, plane_width;	/* plane */
+    gdouble		tension, speed, damping;
+    gint		actuation;
+    gdouble		velocity;
+} PsiPreset;
+
+void		preset_init		(PsiPreset *preset);
+/* The name used in instrument files, "tube", "rod" or "plane" */
+const gchar*	preset_type_name	(PsiPresetType type);
+PsiPresetType	preset_type_lookup	(const gchar *name);
+
+/* Missing values are left at their defaults; FALSE if the file is not
+   an instrument at all */
+gboolean	preset_load		(PsiPreset *preset, const gchar *fname);
+void		preset_save		(const PsiPreset *preset, const gchar *fname);
+
+/* Strikes the instrument, see ps_metal_obj_render_tube() and friends;
+   returns PS_RENDER_UNSTABLE if it blew up */
+gint		preset_render		(const PsiPreset *preset, gint rate, gint len,
+					 gdouble *samples, gdouble att,
+					 PSPercentCallback *cb, gpointer userdata,
+					 PSRenderOptions *opts);
+/* The preset's object, to be struck by ps_metal_topology_render() with
+   its speed, damping and actuation */
+PSMetalTopology*	preset_topology		(const PsiPreset *preset);
+
+#endif
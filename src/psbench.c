@@ -0,0 +1,268 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Benchmarks of the physics kernel: ps_metal_obj_perturb() on its own and
+   whole renders, for every kind of object from the smallest size the GUI
+   allows to ten times the largest.  Every measurement is warmed up once
+   and then repeated; the median is reported.  Progress goes to stderr,
+   the results to stdout as JSON.  Built by "make bench", not installed. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "api-wrapper.h"
+#include "preset.h"
+#include "trace.h"
+
+#define BENCH_RATE 44100
+#define BENCH_TRIALS 5
+/* Steps or samples per trial are doubled until a trial takes this long */
+#define BENCH_TRIAL_SECONDS 0.05
+/* Longest render measured, in seconds of sound */
+#define BENCH_RENDER_SECONDS 1.0
+
+/* What the GUI renders with by default */
+#define BENCH_TENSION 4.0
+#define BENCH_SPEED 0.2
+#define BENCH_DAMPING 0.05
+#define BENCH_VELOCITY 1.0
+
+typedef struct _BenchCase
+{
+    PsiPresetType	type;
+    gint		size[2];	/* second one unused for rods */
+} BenchCase;
+
+/* GUI minimum, in between, GUI maximum, and up to ten times that */
+static const BenchCase cases[] = {
+    { PRESET_TUBE, { PRESET_SIZE_MIN, PRESET_SIZE_MIN } },
+    { PRESET_TUBE, { 10, 10 } },
+    { PRESET_TUBE, { PRESET_TUBE_MAX, PRESET_TUBE_MAX } },
+    { PRESET_TUBE, { 3 * PRESET_TUBE_MAX, 3 * PRESET_TUBE_MAX } },
+    { PRESET_TUBE, { 10 * PRESET_TUBE_MAX, 10 * PRESET_TUBE_MAX } },
+    { PRESET_ROD, { PRESET_SIZE_MIN } },
+    { PRESET_ROD, { 20 } },
+    { PRESET_ROD, { PRESET_ROD_MAX } },
+    { PRESET_ROD, { 10 * PRESET_ROD_MAX } },
+    { PRESET_PLANE, { PRESET_SIZE_MIN, PRESET_SIZE_MIN } },
+    { PRESET_PLANE, { 10, 13 } },
+    { PRESET_PLANE, { PRESET_PLANE_LENGTH_MAX, PRESET_PLANE_WIDTH_MAX } },
+    { PRESET_PLANE, { 3 * PRESET_PLANE_LENGTH_MAX, 3 * PRESET_PLANE_WIDTH_MAX } },
+    { PRESET_PLANE, { 10 * PRESET_PLANE_LENGTH_MAX, 10 * PRESET_PLANE_WIDTH_MAX } }
+};
+
+static PSMetalObj*
+bench_object (const BenchCase *c)
+{
+    switch (c->type) {
+    case PRESET_ROD:
+	return ps_metal_obj_new_rod(c->size[0], BENCH_TENSION);
+    case PRESET_PLANE:
+	return ps_metal_obj_new_plane(c->size[0], c->size[1], BENCH_TENSION);
+    case PRESET_TUBE:
+    default:
+	return ps_metal_obj_new_tube(c->size[0], c->size[1], BENCH_TENSION);
+    }
+}
+
+static gint
+bench_render (const BenchCase *c, gint len, gdouble *samples,
+	      PSRenderOptions *opts)
+{
+    switch (c->type) {
+    case PRESET_ROD:
+	return ps_metal_obj_render_rod(BENCH_RATE, c->size[0], BENCH_TENSION,
+				       BENCH_SPEED, BENCH_DAMPING, 0,
+				       BENCH_VELOCITY, len, samples, NULL, 0.0,
+				       NULL, opts);
+    case PRESET_PLANE:
+	return ps_metal_obj_render_plane(BENCH_RATE, c->size[0], c->size[1],
+					 BENCH_TENSION, BENCH_SPEED,
+					 BENCH_DAMPING, 0, BENCH_VELOCITY, len,
+					 samples, NULL, 0.0, NULL, opts);
+    case PRESET_TUBE:
+    default:
+	return ps_metal_obj_render_tube(BENCH_RATE, c->size[0], c->size[1],
+					BENCH_TENSION, BENCH_SPEED,
+					BENCH_DAMPING, 0, BENCH_VELOCITY, len,
+					samples, NULL, 0.0, NULL, opts);
+    }
+}
+
+static int
+bench_compare (const void *a, const void *b)
+{
+    gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+
+    return da < db ? -1 : da > db;
+}
+
+static gdouble
+bench_median (gdouble *times, gint n)
+{
+    qsort(times, n, sizeof(gdouble), bench_compare);
+
+    return n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2.0;
+}
+
+/* Seconds taken by steps ps_metal_obj_perturb() calls */
+static gdouble
+bench_perturb_once (PSMetalObj *obj, gint steps, gdouble damp)
+{
+    GTimer	*timer;
+    gdouble	elapsed;
+    gint	i;
+
+    timer = g_timer_new();
+    for (i = 0; i < steps; i++)
+	ps_metal_obj_perturb(obj, BENCH_SPEED, damp);
+    elapsed = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+
+    return elapsed;
+}
+
+/* Median nanoseconds per node and step, over trials on a struck object */
+static gdouble
+bench_perturb (const BenchCase *c, gint trials, gint *nodes)
+{
+    PSMetalObj	*obj;
+    gdouble	*times, damp, ns;
+    gint	steps, i;
+
+    obj = bench_object(c);
+    if (obj == NULL)
+	return 0.0;
+    *nodes = obj->num_nodes;
+
+    /* Strike it as a render would, so the springs are working */
+    obj->nodes[1]->pos.x += BENCH_VELOCITY;
+    damp = pow(0.5, 1.0 / (BENCH_DAMPING * BENCH_RATE));
+
+    /* The warmup finds the step count, too */
+    for (steps = 1; bench_perturb_once(obj, steps, damp) < BENCH_TRIAL_SECONDS;
+	 steps *= 2)
+	;
+
+    times = g_new(gdouble, trials);
+    for (i = 0; i < trials; i++)
+	times[i] = bench_perturb_once(obj, steps, damp);
+    ns = bench_median(times, trials) * 1e9 / ((gdouble) steps * obj->num_nodes);
+
+    g_free(times);
+    ps_metal_obj_free(obj);
+
+    return ns;
+}
+
+/* Median samples rendered per second; the render's length and steps
+   per sample are stored in len and substeps */
+static gdouble
+bench_render_rate (const BenchCase *c, gint trials, gint *len, gint *substeps)
+{
+    PSRenderOptions	opts;
+    GTimer	*timer;
+    gdouble	*samples, *rates;
+    gint	max_len = BENCH_RATE * BENCH_RENDER_SECONDS, n, i;
+    gdouble	rate;
+
+    samples = g_new(gdouble, max_len);
+    rates = g_new(gdouble, trials);
+    timer = g_timer_new();
+
+    /* The warmup finds the length, too; large objects get short renders */
+    for (*len = BENCH_RATE / 100; ; *len = MIN(*len * 2, max_len)) {
+	g_timer_start(timer);
+	bench_render(c, *len, samples, NULL);
+	if (*len == max_len || g_timer_elapsed(timer, NULL) >= BENCH_TRIAL_SECONDS)
+	    break;
+    }
+
+    for (i = 0; i < trials; i++) {
+	memset(&opts, 0, sizeof(opts));
+	g_timer_start(timer);
+	n = bench_render(c, *len, samples, &opts);
+	rates[i] = MAX(n, 0) / g_timer_elapsed(timer, NULL);
+    }
+    rate = bench_median(rates, trials);
+    *substeps = opts.substeps;
+
+    g_timer_destroy(timer);
+    g_free(rates);
+    g_free(samples);
+
+    return rate;
+}
+
+int
+main (int argc, char *argv[])
+{
+    const BenchCase	*c;
+    gdouble		ns, rate;
+    gint		trials = BENCH_TRIALS, ncases, nodes = 0, len, substeps, i;
+
+    if (argc > 2 || (argc == 2 && (trials = atoi(argv[1])) < 1)) {
+	fprintf(stderr, "Usage: %s [TRIALS]\n", argv[0]);
+	return 2;
+    }
+
+    trace_open();
+    ncases = G_N_ELEMENTS(cases);
+
+    printf("{\n  \"rate\": %d,\n  \"trials\": %d,\n  \"tension\": %g,\n"
+	   "  \"speed\": %g,\n  \"damping\": %g,\n  \"velocity\": %g,\n"
+	   "  \"results\": [\n", BENCH_RATE, trials, BENCH_TENSION, BENCH_SPEED,
+	   BENCH_DAMPING, BENCH_VELOCITY);
+
+    for (i = 0; i < ncases; i++) {
+	c = &cases[i];
+	if (c->type == PRESET_ROD)
+	    fprintf(stderr, "%-5s %4d      ", preset_type_name(c->type), c->size[0]);
+	else
+	    fprintf(stderr, "%-5s %4d x %-4d", preset_type_name(c->type),
+		    c->size[0], c->size[1]);
+
+	ns = bench_perturb(c, trials, &nodes);
+	rate = bench_render_rate(c, trials, &len, &substeps);
+	fprintf(stderr, " %7d nodes %8.2f ns/node-step %10.0f samples/s %8.2fx real time"
+		" (%d steps per sample)\n", nodes, ns, rate, rate / BENCH_RATE,
+		substeps);
+
+	printf("    { \"type\": \"%s\", \"size\": [%d, %d], \"nodes\": %d,\n"
+	       "      \"perturb_ns_per_node_step\": %.3f,\n"
+	       "      \"render_samples\": %d, \"render_substeps\": %d,\n"
+	       "      \"render_samples_per_second\": %.1f,\n"
+	       "      \"render_realtime_factor\": %.4f }%s\n",
+	       preset_type_name(c->type), c->size[0],
+	       c->type == PRESET_ROD ? 1 : c->size[1], nodes, ns, len, substeps,
+	       rate, rate / BENCH_RATE, i + 1 < ncases ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+
+    return 0;
+}
@@ -31,7 +31,7 @@ static int pulse_open(void)
     pa_sample_spec ss;
     ss.format = PA_SAMPLE_S16NE;
     ss.channels = 1;
-    ss.rate = 44100;
+    ss.rate = conf_rate;
     s = pa_simple_new(NULL, "PSIndustrializer", PA_STREAM_PLAYBACK, NULL, "sound", &ss,
             NULL, NULL, NULL);
     if (!s)
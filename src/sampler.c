@@ -0,0 +1,471 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Sampler instruments.  Each layer's object is built once and struck on
+   a thread pool with one worker per processor.  Three anchor takes per
+   layer are rendered first: the softest, the loudest and one in the
+   middle.  All takes are scaled by the loudest anchor's raw peak, so the
+   layers keep their dynamics instead of all being normalized to full
+   scale.  If the middle anchor lies on the straight line between the
+   other two (the springs stayed linear), the remaining takes are
+   interpolated from the anchors instead of being rendered; otherwise
+   they are rendered and written out as soon as each is done. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <glib.h>
+
+#include "sampler.h"
+#include "fingerprint.h"
+#include "main.h"
+
+#define SAMPLER_RATE 44100
+#define SAMPLER_FORMAT EXPORT_WAV_24
+/* Takes stop at SAMPLER_ATT dB below their peak, or SAMPLER_SECONDS */
+#define SAMPLER_SECONDS 10
+#define SAMPLER_ATT -60.0
+/* Size or tension ratio between neighbouring layers */
+#define SAMPLER_STEP 1.25
+/* Up to this much of a take is analyzed to find its pitch */
+#define SAMPLER_PITCH_SECONDS 1
+
+/* Largest interpolation error, relative to full scale, at which takes
+   are not rendered: -60 dB */
+#define SAMPLER_LINEAR_TOL 1e-3
+
+typedef struct _SamplerLayer
+{
+    PsiPreset		preset;
+    PSMetalTopology	*topo;
+    gdouble		level;		/* raw peak written as full scale */
+    gint		anchors;	/* still being rendered */
+    gint		key;		/* MIDI note it sounds at */
+    gint		lokey, hikey;	/* lokey > hikey if unmapped */
+} SamplerLayer;
+
+typedef struct _SamplerTake
+{
+    SamplerLayer	*layer;
+    gdouble		velocity;
+    PsiExportFormat	format;
+    gchar		*fname;
+    gboolean		anchor;
+    gdouble		*samples;	/* raw render of an anchor */
+    gint		n;
+    gdouble		peak;
+    gboolean		ok;
+} SamplerTake;
+
+typedef struct _SamplerContext
+{
+    GThreadPool		*pool;
+    GAsyncQueue		*done;
+    PsiSamplerProgress	*progress;
+    gpointer		data;
+    gint		written, total;
+    gboolean		ok;
+} SamplerContext;
+
+static gint
+sampler_size (gint size, gdouble factor, gint max)
+{
+    return CLAMP((gint) floor(size * factor + 0.5), PRESET_SIZE_MIN, max);
+}
+
+static void
+sampler_layer (PsiPreset *layer, const PsiPreset *preset, gdouble factor,
+	       PsiSamplerAxis axis)
+{
+    *layer = *preset;
+
+    if (axis == SAMPLER_TENSION) {
+	layer->tension = CLAMP(preset->tension * factor, PRESET_TENSION_MIN,
+			       PRESET_TENSION_MAX);
+	return;
+    }
+
+    layer->height = sampler_size(preset->height, factor, PRESET_TUBE_MAX);
+    layer->circum = sampler_size(preset->circum, factor, PRESET_TUBE_MAX);
+    layer->length = sampler_size(preset->length, factor, PRESET_ROD_MAX);
+    layer->plane_length = sampler_size(preset->plane_length, factor,
+				       PRESET_PLANE_LENGTH_MAX);
+    layer->plane_width = sampler_size(preset->plane_width, factor,
+				      PRESET_PLANE_WIDTH_MAX);
+}
+
+static gboolean
+sampler_same (const PsiPreset *a, const PsiPreset *b)
+{
+    return a->height == b->height && a->circum == b->circum &&
+	a->length == b->length && a->plane_length == b->plane_length &&
+	a->plane_width == b->plane_width && a->tension == b->tension;
+}
+
+/* The note of the strongest partial */
+static gint
+sampler_key (const gdouble *samples, gint n)
+{
+    PsiFingerprint	fp;
+    gint		i, best = -1;
+
+    fingerprint_compute(&fp, samples, MIN(n, SAMPLER_RATE * SAMPLER_PITCH_SECONDS),
+			SAMPLER_RATE);
+    for (i = 0; i < FP_PEAKS; i++)
+	if (fp.freq[i] > 0.0 && (best < 0 || fp.level[i] > fp.level[best]))
+	    best = i;
+    if (best < 0)
+	return 60;
+
+    return CLAMP((gint) floor(69.0 + 12.0 * log(fp.freq[best] / 440.0) / G_LN2 + 0.5),
+		 0, 127);
+}
+
+/* Thread pool worker.  Anchors are kept for sampler_layer_done(), the
+   other takes are written straight away. */
+static void
+sampler_render (gpointer data, gpointer user_data)
+{
+    SamplerTake		*take = data;
+    SamplerLayer	*layer = take->layer;
+    PSRenderOptions	opts = { NULL };
+    gdouble		*samples, gain;
+    gint		n;
+
+    /* Takes are scaled on export, in the same pass as the conversion */
+    opts.raw = TRUE;
+    samples = g_new(gdouble, SAMPLER_RATE * SAMPLER_SECONDS);
+    n = ps_metal_topology_render(layer->topo, SAMPLER_RATE, layer->preset.speed,
+				 layer->preset.damping, layer->preset.actuation,
+				 take->velocity, SAMPLER_RATE * SAMPLER_SECONDS,
+				 samples, NULL, SAMPLER_ATT, NULL, &opts);
+    /* Leaves an empty take, which fails the export */
+    if (n == PS_RENDER_UNSTABLE) {
+	n = 0;
+	opts.peak = 0.0;
+    }
+
+    if (take->anchor) {
+	take->samples = g_renew(gdouble, samples, MAX(n, 1));
+	take->n = n;
+	take->peak = opts.peak;
+    } else {
+	/* Louder than the anchors only happens off the linear range; such
+	   a take is normalized rather than clipped */
+	gain = 1.0 / MAX(layer->level, opts.peak);
+	take->ok = n > 0 && export_save(take->fname, SAMPLER_RATE, take->format,
+					samples, n, gain, FALSE);
+	g_free(samples);
+    }
+
+    g_async_queue_push(user_data, take);
+}
+
+static void
+sampler_written (SamplerContext *ctx, SamplerTake *take)
+{
+    if (!take->ok)
+	ctx->ok = FALSE;
+    if (ctx->progress)
+	ctx->progress(ctx->written, ctx->total, take->fname, ctx->data);
+    ctx->written++;
+}
+
+static void
+sampler_write_raw (SamplerContext *ctx, SamplerTake *take, gdouble *samples,
+		   gint n)
+{
+    take->ok = n > 0 && export_save(take->fname, SAMPLER_RATE, take->format,
+				    samples, n, 1.0 / take->layer->level, FALSE);
+    sampler_written(ctx, take);
+}
+
+/* Called once all anchors of a layer are in: writes them, and either
+   interpolates the other takes or has them rendered */
+static void
+sampler_layer_done (SamplerContext *ctx, SamplerTake *takes, gint velocities)
+{
+    SamplerLayer	*layer = takes[0].layer;
+    SamplerTake		*soft = &takes[0], *loud = &takes[velocities - 1];
+    SamplerTake		*mid = &takes[(velocities - 1) / 2];
+    gdouble		*line, error = 0.0, v0, v1, vm;
+    gint		v, i, n;
+
+    layer->level = 0.0;
+    for (v = 0; v < velocities; v++)
+	if (takes[v].anchor)
+	    layer->level = MAX(layer->level, takes[v].peak);
+    layer->key = sampler_key(loud->samples, loud->n);
+
+    /* How far the middle anchor is off the line through the others.  The
+       error of a straight line through two points of a smooth curve grows
+       quadratically towards the middle, so scale it up to the worst case
+       between soft and loud. */
+    if (soft->n == 0 || loud->n == 0 || mid->n == 0)
+	error = G_MAXDOUBLE;	/* an anchor blew up, render the rest */
+    else if (velocities >= 3) {
+	v0 = soft->velocity;
+	v1 = loud->velocity;
+	vm = mid->velocity;
+	line = g_new(gdouble, mid->n);
+	ps_render_interpolate(soft->samples, soft->n, v0, loud->samples, loud->n,
+			      v1, vm, line, mid->n);
+	for (i = 0; i < mid->n; i++)
+	    error = MAX(error, fabs(line[i] - mid->samples[i]));
+	g_free(line);
+	error *= (v1 - v0) * (v1 - v0) / (4.0 * (vm - v0) * (v1 - vm)) / layer->level;
+    }
+
+    for (v = 0; v < velocities; v++) {
+	if (takes[v].anchor)
+	    continue;
+	if (error > SAMPLER_LINEAR_TOL) {
+	    g_thread_pool_push(ctx->pool, &takes[v], NULL);
+	    continue;
+	}
+	n = MAX(soft->n, loud->n);
+	line = g_new(gdouble, n);
+	ps_render_interpolate(soft->samples, soft->n, soft->velocity,
+			      loud->samples, loud->n, loud->velocity,
+			      takes[v].velocity, line, n);
+	sampler_write_raw(ctx, &takes[v], line, n);
+	g_free(line);
+    }
+
+    for (v = 0; v < velocities; v++)
+	if (takes[v].anchor) {
+	    sampler_write_raw(ctx, &takes[v], takes[v].samples, takes[v].n);
+	    g_free(takes[v].samples);
+	    takes[v].samples = NULL;
+	}
+}
+
+static gint
+sampler_compare_keys (gconstpointer a, gconstpointer b)
+{
+    return (*(SamplerLayer * const *) a)->key - (*(SamplerLayer * const *) b)->key;
+}
+
+/* Splits the keyboard halfway between the layers' notes */
+static void
+sampler_map_keys (SamplerLayer *layers, gint n)
+{
+    SamplerLayer	**sorted, *prev = NULL;
+    gint		i;
+
+    sorted = g_new(SamplerLayer*, n);
+    for (i = 0; i < n; i++)
+	sorted[i] = &layers[i];
+    qsort(sorted, n, sizeof(SamplerLayer*), sampler_compare_keys);
+
+    for (i = 0; i < n; i++) {
+	sorted[i]->lokey = 0;
+	sorted[i]->hikey = 127;
+	if (prev == NULL) {
+	    prev = sorted[i];
+	    continue;
+	}
+	if (sorted[i]->key == prev->key) {
+	    /* Sounds like the previous one, leave it out */
+	    sorted[i]->lokey = 128;
+	    continue;
+	}
+	prev->hikey = (prev->key + sorted[i]->key) / 2;
+	sorted[i]->lokey = prev->hikey + 1;
+	prev = sorted[i];
+    }
+
+    g_free(sorted);
+}
+
+static gboolean
+sampler_write_sfz (const gchar *sfz, const SamplerLayer *layers, gint nlayers,
+		   SamplerTake *takes, gint velocities)
+{
+    FILE	*f;
+    gchar	*base;
+    gint	l, v;
+    gboolean	ok;
+
+    if ((f = fopen(sfz, "w")) == NULL)
+	return FALSE;
+
+    fprintf(f, "// Written by %s\n\n", PACKAGE);
+    /* The takes carry the dynamics themselves */
+    fprintf(f, "<group> amp_veltrack=0\n");
+    for (l = 0; l < nlayers; l++) {
+	if (layers[l].lokey > layers[l].hikey)
+	    continue;
+	for (v = 0; v < velocities; v++) {
+	    base = g_path_get_basename(takes[l * velocities + v].fname);
+	    fprintf(f, "<region> sample=%s lokey=%d hikey=%d pitch_keycenter=%d "
+		    "lovel=%d hivel=%d\n", base, layers[l].lokey, layers[l].hikey,
+		    layers[l].key, v * 127 / velocities + 1,
+		    (v + 1) * 127 / velocities);
+	    g_free(base);
+	}
+    }
+
+    ok = !ferror(f);
+    if (fclose(f) != 0)
+	ok = FALSE;
+
+    return ok;
+}
+
+gboolean
+sampler_export (const PsiPreset *preset, const gchar *sfz, gint velocities,
+		gint layers, PsiSamplerAxis axis, PsiExportFormat format,
+		PsiSamplerProgress *progress, gpointer data)
+{
+    SamplerContext	ctx;
+    SamplerLayer	*layer;
+    SamplerTake		*takes, *take;
+    gchar		*stem;
+    gint		nlayers = 0, l, v;
+
+    ctx.progress = progress;
+    ctx.data = data;
+    ctx.written = 0;
+    ctx.ok = TRUE;
+
+    /* Layers centered on the preset, leaving out any which rounding or
+       the parameter ranges make the same as their neighbour */
+    layer = g_new0(SamplerLayer, layers);
+    for (l = 0; l < layers; l++) {
+	sampler_layer(&layer[nlayers].preset, preset,
+		      pow(SAMPLER_STEP, l - (layers - 1) / 2.0), axis);
+	if (nlayers > 0 && sampler_same(&layer[nlayers].preset,
+					&layer[nlayers - 1].preset))
+	    continue;
+	layer[nlayers].topo = preset_topology(&layer[nlayers].preset);
+	if (layer[nlayers].topo == NULL) {
+	    ctx.ok = FALSE;
+	    break;
+	}
+	nlayers++;
+    }
+
+    stem = g_strndup(sfz, g_str_has_suffix(sfz, ".sfz") ? strlen(sfz) - 4 : strlen(sfz));
+    ctx.total = nlayers * velocities;
+    takes = g_new0(SamplerTake, ctx.total);
+    for (l = 0; l < nlayers; l++)
+	for (v = 0; v < velocities; v++) {
+	    take = &takes[l * velocities + v];
+	    take->layer = &layer[l];
+	    take->velocity = preset->velocity * (v + 1) / velocities;
+	    take->format = format;
+	    take->anchor = v == 0 || v == velocities - 1 ||
+		(velocities >= 3 && v == (velocities - 1) / 2);
+	    take->fname = g_strdup_printf("%s_l%02d_v%02d.%s", stem, l + 1, v + 1,
+					  export_format_extension(format));
+	    if (take->anchor)
+		layer[l].anchors++;
+	}
+    g_free(stem);
+
+    ctx.done = g_async_queue_new();
+    ctx.pool = g_thread_pool_new(sampler_render, ctx.done, g_get_num_processors(),
+				 FALSE, NULL);
+
+    for (l = 0; l < ctx.total; l++)
+	if (takes[l].anchor)
+	    g_thread_pool_push(ctx.pool, &takes[l], NULL);
+
+    while (ctx.written < ctx.total) {
+	take = g_async_queue_pop(ctx.done);
+	if (!take->anchor)
+	    sampler_written(&ctx, take);
+	else if (--take->layer->anchors == 0)
+	    sampler_layer_done(&ctx, &takes[(take->layer - layer) * velocities],
+			       velocities);
+    }
+
+    g_thread_pool_free(ctx.pool, FALSE, TRUE);
+    g_async_queue_unref(ctx.done);
+
+    if (ctx.ok) {
+	sampler_map_keys(layer, nlayers);
+	ctx.ok = sampler_write_sfz(sfz, layer, nlayers, takes, velocities);
+    }
+
+    for (l = 0; l < ctx.total; l++)
+	g_free(takes[l].fname);
+    g_free(takes);
+    for (l = 0; l < nlayers; l++)
+	ps_metal_topology_free(layer[l].topo);
+    g_free(layer);
+
+    return ctx.ok;
+}
+
+static void
+sampler_progress (gint done, gint total, const gchar *fname, gpointer data)
+{
+    fprintf(stderr, _("Rendered %d/%d: %s\n"), done + 1, total, fname);
+}
+
+int
+sampler_main (int argc, char *argv[])
+{
+    PsiPreset		preset;
+    PsiSamplerAxis	axis = SAMPLER_SIZE;
+    gint		velocities = 4, layers = 1;
+
+    if (argc < 3 || argc > 6) {
+	fprintf(stderr, _("Usage: %s --sampler INSTRUMENT OUTPUT.sfz "
+			  "[VELOCITIES [LAYERS [size|tension]]]\n"), PACKAGE);
+	return 2;
+    }
+
+    if (argc > 3)
+	velocities = atoi(argv[3]);
+    if (argc > 4)
+	layers = atoi(argv[4]);
+    if (argc > 5) {
+	if (!g_ascii_strcasecmp(argv[5], "tension"))
+	    axis = SAMPLER_TENSION;
+	else if (g_ascii_strcasecmp(argv[5], "size")) {
+	    fprintf(stderr, _("Layers differ in size or tension, not %s\n"), argv[5]);
+	    return 2;
+	}
+    }
+    if (velocities < 1 || velocities > 127 || layers < 1 || layers > 128) {
+	fprintf(stderr, _("Between 1 and 127 velocities and 128 layers are possible\n"));
+	return 2;
+    }
+
+    if (!preset_load(&preset, argv[1])) {
+	fprintf(stderr, _("%s is not an instrument\n"), argv[1]);
+	return 1;
+    }
+
+    if (!sampler_export(&preset, argv[2], velocities, layers, axis,
+			SAMPLER_FORMAT, sampler_progress, NULL)) {
+	fprintf(stderr, _("Could not write the sampler instrument %s\n"), argv[2]);
+	return 1;
+    }
+
+    return 0;
+}
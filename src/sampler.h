@@ -0,0 +1,52 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_SAMPLER
+#define _PSI_SAMPLER
+
+#include <glib.h>
+
+#include "preset.h"
+#include "export.h"
+
+/* What sets the layers of a sampler instrument apart */
+typedef enum {
+    SAMPLER_SIZE,
+    SAMPLER_TENSION
+} PsiSamplerAxis;
+
+/* Called on the calling thread whenever a take has been written */
+typedef void PsiSamplerProgress (gint done, gint total, const gchar *fname,
+				 gpointer data);
+
+/* Renders preset at velocities strike velocities (up to the preset's own)
+   for up to layers sizes or tensions around the preset's, and writes
+   each take next to the SFZ file sfz along with the mapping itself.
+   Layers are mapped to key ranges by their pitch, takes to velocity
+   ranges.  FALSE if any file could not be written. */
+gboolean	sampler_export		(const PsiPreset *preset, const gchar *sfz,
+					 gint velocities, gint layers,
+					 PsiSamplerAxis axis, PsiExportFormat format,
+					 PsiSamplerProgress *progress, gpointer data);
+
+/* psindustrializer --sampler INSTRUMENT OUTPUT.sfz [VELOCITIES [LAYERS
+   [size|tension]]].  Returns the exit status. */
+int		sampler_main		(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,136 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <glib.h>
+#include <audiofile.h>
+
+#include "similar.h"
+#include "library.h"
+#include "main.h"
+
+/* Matches listed */
+#define SIMILAR_RESULTS 10
+
+gdouble*
+similar_read_sound (const gchar *fname, gdouble seconds, gint *n, gint *rate)
+{
+    AFfilehandle	file;
+    gdouble		*samples, peak = 0.0;
+    gint		i;
+
+    file = afOpenFile(fname, "r", NULL);
+    if (file == AF_NULL_FILEHANDLE)
+	return NULL;
+
+    afSetVirtualSampleFormat(file, AF_DEFAULT_TRACK, AF_SAMPFMT_DOUBLE, 64);
+    afSetVirtualChannels(file, AF_DEFAULT_TRACK, 1);
+    *rate = (gint) afGetRate(file, AF_DEFAULT_TRACK);
+    *n = MIN(afGetFrameCount(file, AF_DEFAULT_TRACK), (AFframecount) (*rate * seconds));
+
+    samples = g_new(gdouble, MAX(*n, 1));
+    *n = afReadFrames(file, AF_DEFAULT_TRACK, samples, *n);
+    afCloseFile(file);
+    if (*n <= 0 || *rate <= 0) {
+	g_free(samples);
+	return NULL;
+    }
+
+    for (i = 0; i < *n; i++)
+	peak = MAX(peak, ABS(samples[i]));
+    if (peak > 0.0)
+	for (i = 0; i < *n; i++)
+	    samples[i] /= peak;
+
+    return samples;
+}
+
+static gboolean
+similar_load_sound (const gchar *fname, PsiFingerprint *fp)
+{
+    gdouble	*samples;
+    gint	n, rate;
+
+    samples = similar_read_sound(fname, LIBRARY_FP_SECONDS, &n, &rate);
+    if (samples == NULL)
+	return FALSE;
+
+    fingerprint_compute(fp, samples, n, rate);
+    g_free(samples);
+
+    return TRUE;
+}
+
+static void
+similar_progress (guint done, guint total, const PsiLibraryEntry *entry, gpointer data)
+{
+    fprintf(stderr, _("Fingerprinting %u/%u: %s\n"), done + 1, total, entry->path);
+}
+
+int
+similar_main (int argc, char *argv[])
+{
+    PsiLibrary		*lib;
+    PsiPreset		preset;
+    PsiFingerprint	target;
+    PsiLibraryMatch	*match;
+    GArray		*ranked;
+    gchar		*index_file;
+    const gchar		*root;
+    guint		i;
+
+    if (argc < 2 || argc > 3) {
+	fprintf(stderr, _("Usage: %s --similar TARGET [FOLDER]\n"), PACKAGE);
+	return 2;
+    }
+    root = argc > 2 ? argv[2] : ".";
+
+    if (g_str_has_suffix(argv[1], ".psii")) {
+	if (!preset_load(&preset, argv[1])) {
+	    fprintf(stderr, _("%s is not an instrument\n"), argv[1]);
+	    return 1;
+	}
+	library_fingerprint_preset(&preset, &target);
+    } else if (!similar_load_sound(argv[1], &target)) {
+	fprintf(stderr, _("Could not read %s\n"), argv[1]);
+	return 1;
+    }
+
+    index_file = library_index_file(root);
+    lib = library_open(index_file, root);
+    g_free(index_file);
+
+    if (library_refresh(lib) < 0 || library_fingerprint(lib, similar_progress, NULL) < 0)
+	fprintf(stderr, _("Could not write the library index.\n"));
+
+    ranked = library_rank(lib, &target);
+    for (i = 0; i < ranked->len && i < SIMILAR_RESULTS; i++) {
+	match = &g_array_index(ranked, PsiLibraryMatch, i);
+	printf("%8.3f  %s\n", match->distance, library_entry(lib, match->index)->path);
+    }
+
+    g_array_free(ranked, TRUE);
+    library_free(lib);
+
+    return 0;
+}
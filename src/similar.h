@@ -0,0 +1,35 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PSI_SIMILAR
+#define _PSI_SIMILAR
+
+#include <glib.h>
+
+/* psindustrializer --similar TARGET [FOLDER]: lists the instruments below
+   FOLDER (the current directory by default) which sound most like
+   TARGET, an instrument or a sound file.  Returns the exit status. */
+int		similar_main		(int argc, char *argv[]);
+
+/* Reads up to seconds of any sound file audiofile can read, mixed down
+   to mono and normalized like a render.  NULL if it can't be read. */
+gdouble*	similar_read_sound	(const gchar *fname, gdouble seconds,
+					 gint *n, gint *rate);
+
+#endif
@@ -0,0 +1,165 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* Render statistics for the status bar and the render log.  Times are
+   measured by the caller around the render; node steps and the stop
+   reason come from PSRenderOptions. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <time.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#  include <sys/resource.h>
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "telemetry.h"
+#include "main.h"
+
+static const gchar *stop_names[] = {
+    "length", "attenuation", "quiet", "unstable"
+};
+
+gdouble
+telemetry_cpu_time (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec	ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    /* The whole process, which is close while only the render runs */
+    return (gdouble) clock() / CLOCKS_PER_SEC;
+}
+
+glong
+telemetry_peak_rss (void)
+{
+#ifdef HAVE_SYS_RESOURCE_H
+    struct rusage	usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+#  ifdef __APPLE__
+	return usage.ru_maxrss / 1024;	/* bytes there */
+#  else
+	return usage.ru_maxrss;
+#  endif
+#endif
+    return 0;
+}
+
+gchar*
+telemetry_describe (const PsiRenderStats *stats)
+{
+    const gchar	*stop;
+    gdouble	seconds = (gdouble) MAX(stats->samples, 0) / stats->rate;
+
+    switch (stats->stop) {
+    case PS_STOP_ATTENUATION:
+	stop = _("decayed");
+	break;
+    case PS_STOP_QUIET:
+	stop = _("came to rest");
+	break;
+    case PS_STOP_UNSTABLE:
+	stop = _("unstable");
+	break;
+    case PS_STOP_LENGTH:
+    default:
+	stop = _("full length");
+	break;
+    }
+
+    return g_strdup_printf(_("%.2f s of sound (%s) in %.3f s, %.1fx real time, "
+			     "%.1f M node-steps/s"),
+			   seconds, stop, stats->wall,
+			   stats->wall > 0.0 ? seconds / stats->wall : 0.0,
+			   stats->wall > 0.0 ? stats->node_steps / stats->wall * 1e-6 : 0.0);
+}
+
+static void
+telemetry_preset_size (const PsiPreset *preset, gchar *size, gsize len)
+{
+    switch (preset->type) {
+    case PRESET_ROD:
+	g_snprintf(size, len, "%d", preset->length);
+	break;
+    case PRESET_PLANE:
+	g_snprintf(size, len, "%dx%d", preset->plane_length, preset->plane_width);
+	break;
+    case PRESET_TUBE:
+    default:
+	g_snprintf(size, len, "%dx%d", preset->height, preset->circum);
+	break;
+    }
+}
+
+gboolean
+telemetry_log (const gchar *fname, const PsiPreset *preset,
+	       const PsiRenderStats *stats)
+{
+    FILE	*out;
+    gboolean	is_new, ok;
+    gchar	size[32], when[32], num[G_ASCII_DTOSTR_BUF_SIZE];
+    gdouble	seconds = (gdouble) MAX(stats->samples, 0) / stats->rate;
+    time_t	now;
+
+    is_new = !g_file_test(fname, G_FILE_TEST_EXISTS);
+    if (!(out = g_fopen(fname, "a")))
+	return FALSE;
+
+    if (is_new)
+	fprintf(out, "time,type,size,tension,speed,damping,actuation,velocity,"
+		"sound_s,wall_s,cpu_s,substeps,node_steps,node_steps_per_s,"
+		"realtime_factor,peak_rss_kib,stop\n");
+
+    now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    telemetry_preset_size(preset, size, sizeof(size));
+
+    /* The C locale's decimal point, whatever the user's */
+    fprintf(out, "%s,%s,%s,", when, preset_type_name(preset->type), size);
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%g", preset->tension));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%g", preset->speed));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%g", preset->damping));
+    fprintf(out, "%d,", preset->actuation);
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%g", preset->velocity));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%.4f", seconds));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%.4f", stats->wall));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%.4f", stats->cpu));
+    fprintf(out, "%d,%" G_GINT64_FORMAT ",", stats->substeps, stats->node_steps);
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%.0f",
+	    stats->wall > 0.0 ? stats->node_steps / stats->wall : 0.0));
+    fprintf(out, "%s,", g_ascii_formatd(num, sizeof(num), "%.3f",
+	    stats->wall > 0.0 ? seconds / stats->wall : 0.0));
+    fprintf(out, "%ld,%s\n", stats->peak_rss, stop_names[stats->stop]);
+
+    ok = !ferror(out);
+    if (fclose(out) != 0)
+	ok = FALSE;
+
+    return ok;
+}
@@ -0,0 +1,54 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PSI_TELEMETRY
+#define _PSI_TELEMETRY
+
+#include <glib.h>
+
+#include "api-wrapper.h"
+#include "preset.h"
+
+/* What a render cost, see telemetry_log() */
+typedef struct _PsiRenderStats
+{
+    gint		rate;
+    gint		samples;	/* PS_RENDER_UNSTABLE if it blew up */
+    gint		substeps;	/* per sample */
+    gint64		node_steps;
+    gdouble		wall, cpu;	/* seconds; cpu of the rendering thread */
+    glong		peak_rss;	/* KiB, of the whole process; 0 if unknown */
+    PSRenderStop	stop;
+} PsiRenderStats;
+
+/* CPU seconds used by the calling thread so far */
+gdouble		telemetry_cpu_time	(void);
+/* Largest resident size the process has had, in KiB; 0 if unknown */
+glong		telemetry_peak_rss	(void);
+
+/* One line for the status bar, to be freed */
+gchar*		telemetry_describe	(const PsiRenderStats *stats);
+
+/* Appends one line describing the render of preset to the CSV file
+   fname, writing the header first if the file is new */
+gboolean	telemetry_log		(const gchar *fname, const PsiPreset *preset,
+					 const PsiRenderStats *stats);
+
+#endif
@@ -0,0 +1,134 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+/* Events are written as they end, one line each, under a lock; they are
+   only taken around whole blocks of work, so that is cheap enough.  The
+   file is a JSON array of complete ("X") events and thread names. */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "trace.h"
+
+gboolean trace_enabled = FALSE;
+
+static FILE *trace_file = NULL;
+static GMutex trace_mutex;
+static gint64 trace_epoch;
+static gint trace_threads = 0;
+static GPrivate trace_tid = G_PRIVATE_INIT(NULL);
+
+static void
+trace_close (void)
+{
+    g_mutex_lock(&trace_mutex);
+    trace_enabled = FALSE;
+    fprintf(trace_file, "\n]\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    g_mutex_unlock(&trace_mutex);
+}
+
+void
+trace_open (void)
+{
+    const gchar *fname;
+
+    if (trace_file || !(fname = g_getenv("PSI_TRACE")) || !*fname)
+	return;
+
+    if (!(trace_file = g_fopen(fname, "w"))) {
+	g_warning("Could not open trace file %s", fname);
+	return;
+    }
+
+    g_mutex_init(&trace_mutex);
+    trace_epoch = g_get_monotonic_time();
+    fprintf(trace_file, "[\n");
+    trace_enabled = TRUE;
+    trace_thread_name("main");
+    atexit(trace_close);
+}
+
+/* Small numbers in order of first use read better than thread ids */
+static gint
+trace_thread_id (void)
+{
+    gint id = GPOINTER_TO_INT(g_private_get(&trace_tid));
+
+    if (id == 0) {
+	id = g_atomic_int_add(&trace_threads, 1) + 1;
+	g_private_set(&trace_tid, GINT_TO_POINTER(id));
+    }
+
+    return id;
+}
+
+/* Every event but the first is preceded by a comma */
+static void
+trace_separate (void)
+{
+    static gboolean first = TRUE;
+
+    if (!first)
+	fprintf(trace_file, ",\n");
+    first = FALSE;
+}
+
+void
+trace_thread_name (const gchar *name)
+{
+    gint tid;
+
+    if (!trace_enabled)
+	return;
+
+    tid = trace_thread_id();
+    g_mutex_lock(&trace_mutex);
+    if (trace_file) {
+	trace_separate();
+	fprintf(trace_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":%d,\"args\":{\"name\":\"%s\"}}", tid, name);
+    }
+    g_mutex_unlock(&trace_mutex);
+}
+
+void
+trace_write (const gchar *name, gint64 start)
+{
+    gint64 end = g_get_monotonic_time();
+    gint tid = trace_thread_id();
+
+    g_mutex_lock(&trace_mutex);
+    if (trace_file) {
+	trace_separate();
+	fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+		"\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT "}",
+		name, tid, start - trace_epoch, end - start);
+    }
+    g_mutex_unlock(&trace_mutex);
+}
@@ -0,0 +1,54 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2005 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _PSI_TRACE
+#define _PSI_TRACE
+
+#include <glib.h>
+
+/* Timeline of the render pipeline in Chrome's trace event format, for
+   chrome://tracing or ui.perfetto.dev.  It is written to the file named
+   by $PSI_TRACE; without it, every call below is a test of a flag. */
+
+extern gboolean trace_enabled;
+
+/* Opens $PSI_TRACE if set; call before starting any threads.  The file
+   is completed at exit. */
+void		trace_open		(void);
+
+/* Labels the calling thread's row in the timeline */
+void		trace_thread_name	(const gchar *name);
+void		trace_write		(const gchar *name, gint64 start);
+
+/* A span from trace_begin() to trace_end() shows up as name */
+static inline gint64
+trace_begin (void)
+{
+    return trace_enabled ? g_get_monotonic_time() : 0;
+}
+
+static inline void
+trace_end (const gchar *name, gint64 start)
+{
+    if (trace_enabled)
+	trace_write(name, start);
+}
+
+#endif
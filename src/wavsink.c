@@ -0,0 +1,104 @@
+/*  Power Station Industrializer
+ *  Copyright (c) 2000 David A. Bartold
+ *  Copyright (c) 2003 Yury Aliaev
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Output driver which streams everything played into a .WAV file.
+   The file is $PSI_WAVSINK if set, or playback.wav in the configuration
+   directory otherwise; it is recreated every time the driver is opened
+   and its header is finalized when the driver is closed. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <audiofile.h>
+
+#include "wavsink.h"
+
+/* Max length of error message */
+#define ERROR_SIZE 256
+
+static AFfilehandle sink = AF_NULL_FILEHANDLE;
+static gchar wavsink_error[ERROR_SIZE];
+
+static int wavsink_open(void)
+{
+    AFfilesetup setup;
+    gchar *fname;
+
+    if (g_getenv("PSI_WAVSINK"))
+	fname = g_strdup(g_getenv("PSI_WAVSINK"));
+    else
+	fname = g_build_filename(g_get_home_dir(), "."PACKAGE, "playback.wav", NULL);
+
+    setup = afNewFileSetup();
+    afInitFileFormat(setup, AF_FILE_WAVE);
+    afInitSampleFormat(setup, AF_DEFAULT_TRACK, AF_SAMPFMT_TWOSCOMP, 16);
+    afInitByteOrder(setup, AF_DEFAULT_TRACK, AF_BYTEORDER_LITTLEENDIAN);
+    afInitChannels(setup, AF_DEFAULT_TRACK, 1);
+    afInitRate(setup, AF_DEFAULT_TRACK, (double) conf_rate);
+
+    sink = afOpenFile(fname, "w", setup);
+    afFreeFileSetup(setup);
+
+    if (sink == AF_NULL_FILEHANDLE) {
+	g_snprintf(wavsink_error, ERROR_SIZE, "Could not open %s for writing", fname);
+	g_free(fname);
+	return -1;
+    }
+
+    g_free(fname);
+    return 0;
+}
+
+static int wavsink_play(gint16 * ptr, int n)
+{
+    int written;
+
+    if (sink == AF_NULL_FILEHANDLE)
+	return -1;
+
+    written = afWriteFrames(sink, AF_DEFAULT_TRACK, ptr, n);
+    if (written < n) {
+	g_strlcpy(wavsink_error, "Could not write to the sink file", ERROR_SIZE);
+	return -1;
+    }
+
+    return written;
+}
+
+static void wavsink_close(void)
+{
+    if (sink != AF_NULL_FILEHANDLE)
+	afCloseFile(sink);
+    sink = AF_NULL_FILEHANDLE;
+}
+
+static const char *wavsink_err(int errnum)
+{
+    return wavsink_error;
+}
+
+drv driver_wavsink = {
+    N_("WAV file sink"),
+    wavsink_open,
+    wavsink_play,
+    wavsink_close,
+    wavsink_err
+};
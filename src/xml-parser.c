@@ -26,6 +26,68 @@
 
 static gchar buf[256];
 
+/* Every element with a name attribute is indexed under each of its
+   ancestor path suffixes: "type", "parent/type" and so on up to the root
+   element.  This serves both the relative lookups of xmlp_get() (which
+   used to be "//path/type[@name]" XPath queries) and the absolute ones of
+   xmlp_set().  The first node in document order wins, as it did then. */
+static gchar*
+xmlp_key (const gchar *path, const gchar *type, const gchar *name)
+{
+    return g_strconcat(path, type, "\n", name, NULL);
+}
+
+static void
+xmlp_index_node (xmlpContext *cntxt, xmlNodePtr node)
+{
+    xmlChar	*name;
+    xmlNodePtr	cur;
+    GString	*path;
+    gchar	*key;
+
+    if(!(name = xmlGetProp(node, (const xmlChar *)"name")))
+	return;
+
+    path = g_string_new("");
+    for(cur = node; cur && cur->type == XML_ELEMENT_NODE; cur = cur->parent) {
+	if(cur != node)
+	    g_string_prepend_c(path, '/');
+	g_string_prepend(path, (const gchar *)cur->name);
+
+	key = xmlp_key(path->str, "", (const gchar *)name);
+	if(g_hash_table_lookup(cntxt->index, key))
+	    g_free(key);
+	else
+	    g_hash_table_insert(cntxt->index, key, node);
+    }
+
+    g_string_free(path, TRUE);
+    xmlFree(name);
+}
+
+static void
+xmlp_index_tree (xmlpContext *cntxt, xmlNodePtr cur)
+{
+    for(; cur; cur = cur->next)
+	if(cur->type == XML_ELEMENT_NODE) {
+	    xmlp_index_node(cntxt, cur);
+	    xmlp_index_tree(cntxt, cur->xmlChildrenNode);
+	}
+}
+
+static xmlNodePtr
+xmlp_lookup (xmlpContext *cntxt, const gchar *path, const gchar *type, const gchar *name)
+{
+    xmlNodePtr	node;
+    gchar	*key;
+
+    key = xmlp_key(path, type, name);
+    node = g_hash_table_lookup(cntxt->index, key);
+    g_free(key);
+
+    return node;
+}
+
 xmlpContext*
 xmlp_new_doc (const gchar *docname, const gchar *keyword)
 {
@@ -40,7 +102,7 @@ xmlp_new_doc (const gchar *docname, const gchar *keyword)
     cur = xmlNewDocNode(cntxt->doc, NULL, keyword, NULL);
     xmlDocSetRootElement(cntxt->doc, cur);
 
-    cntxt->context = xmlXPathNewContext(cntxt->doc);
+    cntxt->index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     return cntxt;
 }
 
@@ -68,26 +130,15 @@ xmlp_get_doc (const gchar *docname, const gchar *keyword)
 	return NULL;
     }
 
-    cntxt->context = xmlXPathNewContext(cntxt->doc);
+    cntxt->index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    xmlp_index_tree(cntxt, cur);
     return cntxt;
 }
 
-static xmlXPathObjectPtr
-xmlp_get_nodeset (xmlpContext *cntxt, gchar *xpath)
-{
-    xmlXPathObjectPtr result;
-
-    result = xmlXPathEvalExpression((xmlChar *)xpath, cntxt->context);
-    if(xmlXPathNodeSetIsEmpty(result->nodesetval))
-	return NULL;
-
-    return result;
-}
-
 void
 xmlp_free (xmlpContext *cntxt)
 {
-    xmlXPathFreeContext(cntxt->context);
+    g_hash_table_destroy(cntxt->index);
     xmlFreeDoc(cntxt->doc);
     g_free(cntxt->name);
     g_free(cntxt->type);
@@ -105,22 +156,10 @@ xmlp_free_string (gchar *str)
 xmlChar*
 xmlp_get (xmlpContext *cntxt, const gchar *xpath, const gchar *type, const gchar *name)
 {
-    xmlXPathObjectPtr	result;
-    xmlNodeSetPtr	nodeset;
-    xmlChar		*keyword;
-    gchar		*path;
-    
-    path = g_strconcat("//", xpath, type, "[attribute::name=\"", name, "\"]", NULL);
-    result = xmlp_get_nodeset(cntxt, path);
-    g_free(path);
-
-    if(result) {
-	nodeset = result->nodesetval;
-	keyword = xmlNodeListGetString(cntxt->doc, nodeset->nodeTab[0]->xmlChildrenNode, 1);
-	xmlXPathFreeObject (result);
-	
-	return keyword;
-    }
+    xmlNodePtr	node;
+
+    if((node = xmlp_lookup(cntxt, xpath, type, name)))
+	return xmlNodeListGetString(cntxt->doc, node->xmlChildrenNode, 1);
     
     return NULL;
 }
@@ -251,21 +290,18 @@ lookup_node (xmlNodePtr cur, const gchar *name, const gchar *aname, const gchar
 void
 xmlp_set (xmlpContext *cntxt, const gchar *xpath, const gchar *type, const gchar *name, const gchar *value)
 {
-    xmlXPathObjectPtr	result;
-    xmlNodeSetPtr	nodeset;
-    gchar		*path;
+    gchar		*path, *root;
     gchar		**path_split, **na;
     xmlNodePtr		cur, next, sub;
     
-    path = g_strconcat("/", cntxt->type, "/", xpath, type, "[attribute::name=\"", name, "\"]", NULL);
-    result = xmlp_get_nodeset(cntxt, path);
-
-    if(result) { /* The value already presents */
-	nodeset = result->nodesetval;
-	xmlNodeSetContent(nodeset->nodeTab[0], (xmlChar *)value);
-	xmlXPathFreeObject (result);
-	g_free(path);
-    } else { /* We need to create several nodes */
+    root = g_strconcat(cntxt->type, "/", xpath, NULL);
+    cur = xmlp_lookup(cntxt, root, type, name);
+    g_free(root);
+
+    if(cur) /* The value already presents */
+	xmlNodeSetContent(cur, (xmlChar *)value);
+    else { /* We need to create several nodes */
+	path = g_strconcat("/", cntxt->type, "/", xpath, type, "[attribute::name=\"", name, "\"]", NULL);
 	guint		i = 1; /* The 0-th and 1-st element are empty */
 	gboolean	exist = TRUE;
 
@@ -309,8 +345,10 @@ xmlp_set (xmlpContext *cntxt, const gchar *xpath, const gchar *type, const gchar
 	}
 	
 	xmlNodeSetContent(cur, (xmlChar*)value);
+	xmlp_index_node(cntxt, cur);
 	
 	g_strfreev(path_split);
+	g_free(path);
     }
 }
 
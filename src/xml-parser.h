@@ -19,13 +19,12 @@
  */
 
 #include <libxml/parser.h>
-#include <libxml/xpath.h>
 #include <glib.h>
 
 typedef struct _xmlpContext
 {
     xmlDocPtr doc;
-    xmlXPathContextPtr context;
+    GHashTable *index;	/* "path/type\nname" -> first matching node */
     gchar *name;
     gchar *type;
 } xmlpContext;